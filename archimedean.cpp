@@ -432,7 +432,7 @@ struct hrmap_archimedean : hrmap {
     }
 
   ~hrmap_archimedean() {
-    clearfrom(origin);
+    if(!bulk_release()) clearfrom(origin);
     altmap.clear();
     archimedean_gmatrix.clear();
     if(current_altmap) {
@@ -139,8 +139,8 @@ void generateAlts(heptagon *h, int levs, bool link_cdata) {
   if(relspin == -4 && geometry != gFieldQuotient) {
     if(h->alt != h->alt->alt) {
       printf("relspin {%p:%p}\n", h->alt, h->alt->alt);
-      {for(int i=0; i<S7; i++) printf("%p ", h->alt->move(i));} printf(" ALT\n");
-      {for(int i=0; i<S7; i++) printf("%p ", h->move(i));} printf(" REAL\n");
+      {for(int i=0; i<S7; i++) printf("%p ", (void*) h->alt->move(i));} printf(" ALT\n");
+      {for(int i=0; i<S7; i++) printf("%p ", (void*) h->move(i));} printf(" REAL\n");
       {for(int i=0; i<S7; i++) printf("%p ", h->move(i)->alt);} printf(" REAL ALT\n");
       }
     relspin = 3;
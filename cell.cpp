@@ -19,8 +19,155 @@ int fixdir(int a, cell *c) { a %= c->type; if(a<0) a += c->type; return a; }
 
 int cellcount = 0;
 
+// --- slab arenas ---
+
+slab_arena *current_arena;
+
+vector<char*> slab_table;
+// unused indices in slab_table
+vector<int> slab_table_free;
+
+// used when no map is being built, e.g. before initcells
+slab_arena default_arena;
+
+#if CAP_THREADS
+thread_local slab_arena *worker_arena;
+// init_slab may be called from several threads of genlayers
+std::mutex slab_table_lock;
+#else
+slab_arena *worker_arena;
+#endif
+
+slab_arena *get_arena() {
+  if(worker_arena) return worker_arena;
+  return current_arena ? current_arena : &default_arena;
+  }
+
+slab_arena::slab_arena() {
+  for(auto& sc: classes) sc.next = sc.end = NULL, sc.free_list = NULL;
+  live[0] = live[1] = 0;
+  mapped = NULL; mapped_slabs = 0;
+  }
+
+void slab_arena::init_slab(char *slab, int size) {
+  header *h = (header*) slab;
+  h->owner = this;
+  h->size = size;
+  #if CAP_COMPRESSED_MOVES
+  #if CAP_THREADS
+  std::lock_guard<std::mutex> lock(slab_table_lock);
+  #endif
+  if(isize(slab_table_free)) {
+    h->index = slab_table_free.back();
+    slab_table_free.pop_back();
+    slab_table[h->index] = slab;
+    }
+  else {
+    // reserve early, so that the table does not end up above the slabs
+    // and prevent the heap from shrinking
+    if(slab_table.empty()) slab_table.reserve(1<<16);
+    h->index = isize(slab_table);
+    slab_table.push_back(slab);
+    }
+  #else
+  h->index = -1;
+  #endif
+  }
+
+void *slab_arena::allocate(int size) {
+  int id = (size + GRANULE - 1) / GRANULE;
+  if(id >= CLASSES) {
+    printf("slab_arena: object too large (%d bytes)\n", size);
+    exit(1);
+    }
+  size_class& sc = classes[id];
+  if(sc.free_list) {
+    void *p = sc.free_list;
+    sc.free_list = *(void**) p;
+    return p;
+    }
+  size = id * GRANULE;
+  if(sc.next + size > sc.end) {
+    void *mem;
+    #if ISWINDOWS
+    mem = _aligned_malloc(SLAB_SIZE, SLAB_SIZE);
+    #else
+    if(posix_memalign(&mem, SLAB_SIZE, SLAB_SIZE)) mem = NULL;
+    #endif
+    if(!mem) { printf("slab_arena: out of memory\n"); exit(1); }
+    char *slab = (char*) mem;
+    slabs.push_back(slab);
+    init_slab(slab, size);
+    sc.next = slab + ((sizeof(header) + GRANULE - 1) / GRANULE) * GRANULE;
+    sc.end = slab + SLAB_SIZE;
+    }
+  void *p = sc.next;
+  sc.next += size;
+  return p;
+  }
+
+void slab_arena::release(void *p) {
+  header *h = (header*) ((uintptr_t) p & ~uintptr_t(SLAB_SIZE-1));
+  void*& fl = h->owner->classes[h->size / GRANULE].free_list;
+  *(void**) p = fl;
+  fl = p;
+  }
+
+slab_arena::~slab_arena() {
+  heptacount -= live[0];
+  cellcount -= live[1];
+  for(char *slab: slabs) {
+    #if CAP_COMPRESSED_MOVES
+    int id = header_of(slab)->index;
+    slab_table[id] = NULL;
+    slab_table_free.push_back(id);
+    #endif
+    #if ISWINDOWS
+    _aligned_free(slab);
+    #else
+    free(slab);
+    #endif
+    }
+  #if CAP_SNAPSHOT
+  if(mapped) {
+    #if CAP_COMPRESSED_MOVES
+    for(int i=0; i<mapped_slabs; i++) {
+      int id = header_of(mapped + i * SLAB_SIZE)->index;
+      slab_table[id] = NULL;
+      slab_table_free.push_back(id);
+      }
+    #endif
+    munmap(mapped, size_t(mapped_slabs) * SLAB_SIZE);
+    }
+  #endif
+  }
+
+// take over the slabs of an arena of a genlayers thread; the objects
+// allocated there have not been counted yet
+void slab_arena::absorb(slab_arena& a) {
+  for(char *slab: a.slabs) {
+    header_of(slab)->owner = this;
+    slabs.push_back(slab);
+    }
+  a.slabs.clear();
+  heptacount += a.live[0]; live[0] += a.live[0]; a.live[0] = 0;
+  cellcount += a.live[1]; live[1] += a.live[1]; a.live[1] = 0;
+  }
+
+void release_map_arena(hrmap *m) {
+  if(!m->arena) return;
+  if(current_arena == m->arena) current_arena = NULL;
+  delete m->arena;
+  m->arena = NULL;
+  }
+
 void initcell(cell *c); // from game.cpp
 
+buffer_pool<cell*> celllist_pool;
+buffer_pool<int> celldist_pool;
+manual_celllister *bfs_owner;
+unsigned bfs_generation;
+
 cell *newCell(int type, heptagon *master) {
   cell *c = tailored_alloc<cell> (type);
   c->type = type;
@@ -34,6 +181,22 @@ struct cdata {
   int bits;
   };
 
+cdata *new_cdata(const cdata& d) {
+  #ifndef NO_SLAB_ARENA
+  return new (get_arena()->allocate(sizeof(cdata))) cdata(d);
+  #else
+  return new cdata(d);
+  #endif
+  }
+
+void delete_cdata(cdata *d) {
+  #ifndef NO_SLAB_ARENA
+  slab_arena::release(d);
+  #else
+  delete d;
+  #endif
+  }
+
 // -- hrmap ---
 
 hrmap *currentmap;
@@ -99,7 +262,7 @@ struct hrmap_spherical : hrmap {
   hrmap_spherical() {
     mvar = variation;
     for(int i=0; i<spherecells(); i++) {
-      heptagon& h = *(dodecahedron[i] = new heptagon);
+      heptagon& h = *(dodecahedron[i] = tailored_alloc<heptagon> (MAX_EDGE));
       h.s = hsOrigin;
       h.emeraldval = i;
       h.zebraval = i;
@@ -189,8 +352,9 @@ struct hrmap_spherical : hrmap {
 
   ~hrmap_spherical() {
     dynamicval<eVariation> ph(variation, mvar);
+    if(bulk_release()) return;
     for(int i=0; i<spherecells(); i++) clearHexes(dodecahedron[i]);
-    for(int i=0; i<spherecells(); i++) delete dodecahedron[i];
+    for(int i=0; i<spherecells(); i++) tailored_delete(dodecahedron[i]);
     }    
 
   void verify() {
@@ -533,7 +697,7 @@ struct hrmap_torus : hrmap {
     }
   
   ~hrmap_torus() {
-    for(cell *c: all) delete c;
+    if(!bulk_release()) for(cell *c: all) tailored_delete(c);
     }
   };
 
@@ -559,9 +723,9 @@ struct hrmap_euclidean : hrmap {
       for(int y=0; y<256; y++) for(int x=0; x<256; x++)
         a[y][x] = NULL;
       }
-    ~euclideanSlab() {
+    void clear() {
       for(int y=0; y<256; y++) for(int x=0; x<256; x++)
-        if(a[y][x]) delete a[y][x];
+        if(a[y][x]) tailored_delete(a[y][x]);
       }
     };
   
@@ -590,6 +754,7 @@ struct hrmap_euclidean : hrmap {
   ~hrmap_euclidean() {
     for(int y=0; y<slabs; y++) for(int x=0; x<slabs; x++)
       if(euclidean[y][x]) { 
+        if(!bulk_release()) euclidean[y][x]->clear();
         delete euclidean[y][x];
         euclidean[y][x] = NULL;
         }
@@ -969,7 +1134,7 @@ struct hrmap_quotient : hrmap {
     // printf("all cells = %d\n", TOT*(S7+S3)/S3);
     if(!TOT) exit(1);
     allh.resize(TOT);
-    for(int i=0; i<TOT; i++) allh[i] = new heptagon;
+    for(int i=0; i<TOT; i++) allh[i] = tailored_alloc<heptagon> (MAX_EDGE);
     // heptagon *oldorigin = origin;
     allh[0]->alt = base.origin;
   
@@ -1028,9 +1193,10 @@ struct hrmap_quotient : hrmap {
   heptagon *getOrigin() { return allh[0]; }
 
   ~hrmap_quotient() {
+    if(bulk_release()) return;
     for(int i=0; i<isize(allh); i++) {
       clearHexes(allh[i]);
-      delete allh[i];
+      tailored_delete(allh[i]);
       }
     }
   
@@ -1172,6 +1338,11 @@ hookset<hrmap*()> *hooks_newmap;
 void initcells() {
   DEBB(DF_INIT, (debugfile,"initcells\n"));
   
+  #ifndef NO_SLAB_ARENA
+  slab_arena *arena = new slab_arena;
+  current_arena = arena;
+  #endif
+
   hrmap* res = callhandlers((hrmap*)nullptr, hooks_newmap);
   if(res) currentmap = res;  
   else if(geometry == gCrystal) currentmap = crystal::new_map();
@@ -1182,6 +1353,9 @@ void initcells() {
   else if(quotient) currentmap = new quotientspace::hrmap_quotient;
   else currentmap = new hrmap_hyperbolic;
   
+  #ifndef NO_SLAB_ARENA
+  currentmap->arena = arena;
+  #endif
   allmaps.push_back(currentmap);
 
   windmap::create();  
@@ -1203,7 +1377,7 @@ void clearcell(cell *c) {
     c->move(t)->move(c->c.spin(t)) = NULL;
     }
   DEBMEM ( printf("DEL %p\n", c); )
-  delete c;
+  tailored_delete(c);
   }
 
 heptagon deletion_marker;
@@ -1221,7 +1395,7 @@ template<class T> void subcell(cell *c, const T& t) {
 
 void clearHexes(heptagon *at) {
   if(at->c7 && at->cdata) {
-    delete at->cdata;
+    delete_cdata(at->cdata);
     at->cdata = NULL;
     }
   if(IRREGULAR) irr::clear_links(at);
@@ -1273,7 +1447,7 @@ void clearfrom(heptagon *at) {
       at->move(i) = NULL;
       }
     clearHexes(at);
-    delete at;
+    tailored_delete(at);
     }
 //printf("maxq = %d\n", maxq);
   }
@@ -1295,7 +1469,7 @@ void verifycell(cell *c) {
 void verifycells(heptagon *at) {
   if(GOLDBERG || IRREGULAR || archimedean) return;
   for(int i=0; i<S7; i++) if(at->move(i) && at->move(i)->move(at->c.spin(i)) && at->move(i)->move(at->c.spin(i)) != at) {
-    printf("hexmix error %p [%d s=%d] %p %p\n", at, i, at->c.spin(i), at->move(i), at->move(i)->move(at->c.spin(i)));
+    printf("hexmix error %p [%d s=%d] %p %p\n", at, i, at->c.spin(i), (void*) at->move(i), (void*) at->move(i)->move(at->c.spin(i)));
     }
   if(!sphere && !quotient) 
     for(int i=0; i<S7; i++) if(at->move(i) && at->c.spin(i) == 0 && at->s != hsOrigin)
@@ -1549,7 +1723,7 @@ cdata *getHeptagonCdata(heptagon *h) {
   if(sphere || quotient) h = currentmap->gamestart()->master;
 
   if(h == currentmap->gamestart()->master) {
-    return h->cdata = new cdata(orig_cdata);
+    return h->cdata = new_cdata(orig_cdata);
     }
   
   cdata mydata = *getHeptagonCdata(h->move(0));
@@ -1615,7 +1789,7 @@ cdata *getHeptagonCdata(heptagon *h) {
       } */
     }
 
-  return h->cdata = new cdata(mydata);
+  return h->cdata = new_cdata(mydata);
   }
 
 cdata *getEuclidCdata(int h) {
@@ -1729,7 +1903,89 @@ int heptdistance(cell *c1, cell *c2) {
   else return heptdistance(c1->master, c2->master);
   }
 
-map<pair<cell*, cell*>, int> saved_distances;
+// --- distance tables ---
+
+// limit on the memory used by the distance tables, evicted in the LRU order
+int distance_cache_mb = 64;
+
+// dense indices of the cells seen by the distance tables in bounded geometries
+unordered_map<cell*, int> cell_ids;
+
+list<distance_table> distance_tables;
+unordered_map<cell*, list<distance_table>::iterator> distance_table_of;
+size_t distance_bytes;
+
+int cell_index(cell *c) {
+  auto it = cell_ids.find(c);
+  if(it != cell_ids.end()) return it->second;
+  int id = isize(cell_ids);
+  cell_ids[c] = id;
+  return id;
+  }
+
+int distance_table::get(cell *c) const {
+  if(dense) {
+    auto it = cell_ids.find(c);
+    if(it == cell_ids.end() || it->second >= isize(dist) || dist[it->second] == 255) return -1;
+    return dist[it->second];
+    }
+  auto it = lower_bound(near.begin(), near.end(), make_pair(c, (unsigned char) 0));
+  if(it == near.end() || it->first != c) return -1;
+  return it->second;
+  }
+
+const distance_table& distances_from(cell *c) {
+  auto it = distance_table_of.find(c);
+  if(it != distance_table_of.end()) {
+    distance_tables.splice(distance_tables.begin(), distance_tables, it->second);
+    return *it->second;
+    }
+  
+  distance_tables.emplace_front();
+  distance_table& dt = distance_tables.front();
+  dt.source = c;
+  dt.dense = bounded;
+  if(bounded) {
+    celllister cl(c, 100, 100000000, NULL);
+    for(cell *c1: cl.lst) cell_index(c1);
+    dt.dist.resize(isize(cell_ids), 255);
+    for(int i=0; i<isize(cl.lst); i++)
+      dt.dist[cell_ids[cl.lst[i]]] = cl.dists[i];
+    }
+  else {
+    celllister cl(c, 64, 1000, NULL);
+    dt.near.resize(isize(cl.lst));
+    for(int i=0; i<isize(cl.lst); i++)
+      dt.near[i] = make_pair(cl.lst[i], (unsigned char) cl.dists[i]);
+    sort(dt.near.begin(), dt.near.end());
+    }
+  distance_table_of[c] = distance_tables.begin();
+  distance_bytes += dt.bytes();
+  
+  while(distance_bytes > (size_t(distance_cache_mb) << 20) && isize(distance_tables) > 1) {
+    distance_bytes -= distance_tables.back().bytes();
+    distance_table_of.erase(distance_tables.back().source);
+    distance_tables.pop_back();
+    }
+  return dt;
+  }
+
+// grouped by the source, so that each table is computed at most once
+vector<int> distances_between(const vector<pair<cell*, cell*>>& pairs) {
+  vector<int> order(isize(pairs));
+  for(int i=0; i<isize(pairs); i++) order[i] = i;
+  sort(order.begin(), order.end(), [&] (int i, int j) { return pairs[i].first < pairs[j].first; });
+  vector<int> res(isize(pairs));
+  for(int i: order) res[i] = celldistance(pairs[i].first, pairs[i].second);
+  return res;
+  }
+
+void clear_distance_tables() {
+  distance_tables.clear();
+  distance_table_of.clear();
+  cell_ids.clear();
+  distance_bytes = 0;
+  }
 
 int celldistance(cell *c1, cell *c2) {
   
@@ -1746,43 +2002,48 @@ int celldistance(cell *c1, cell *c2) {
     return currfp.getdist(fieldpattern::fieldval(c1), fieldpattern::fieldval(c2));
   
   if(bounded) {
-    
-    if(saved_distances.count(make_pair(c1,c2)))
-      return saved_distances[make_pair(c1,c2)];
-
-    celllister cl(c1, 100, 100000000, NULL);
-    for(int i=0; i<isize(cl.lst); i++)
-      saved_distances[make_pair(c1, cl.lst[i])] = cl.dists[i];
-
-    if(saved_distances.count(make_pair(c1,c2)))
-      return saved_distances[make_pair(c1,c2)];
-
-    return 64;
+    int d = distances_from(c1).get(c2);
+    return d < 0 ? 64 : d;
     }
   
   if(geometry == gCrystal) return crystal::precise_distance(c1, c2);
   
   if(masterless || archimedean || quotient) {
-    
-    if(saved_distances.count(make_pair(c1,c2)))
-      return saved_distances[make_pair(c1,c2)];
-      
-    if(isize(saved_distances) > 1000000) saved_distances.clear();
-
-    celllister cl(c1, 64, 1000, c2);
-
-    for(int i=0; i<isize(cl.lst); i++)
-      saved_distances[make_pair(c1, cl.lst[i])] = cl.dists[i];
-
-    if(saved_distances.count(make_pair(c1,c2)))
-      return saved_distances[make_pair(c1,c2)];
-
-    return 64;
+    int d = distances_from(c1).get(c2);
+    return d < 0 ? 64 : d;
     }
   
   return hyperbolic_celldistance(c1, c2);
   }
 
+// breadth-first search from both ends, always extending the smaller side
+// by a full layer; the first cell reached from both sides lies on a
+// shortest path
+
+vector<cell*> bidirectional_shortest_path(cell *c1, cell *c2) {
+  map<cell*, cell*> from[2];
+  vector<cell*> layer[2];
+  from[0][c1] = NULL; layer[0].push_back(c1);
+  from[1][c2] = NULL; layer[1].push_back(c2);
+  cell *meet = c1 == c2 ? c1 : NULL;
+  while(!meet) {
+    int s = isize(layer[0]) <= isize(layer[1]) ? 0 : 1;
+    vector<cell*> next;
+    for(cell *c: layer[s]) forCellCM(c3, c) if(!from[s].count(c3)) {
+      from[s][c3] = c;
+      next.push_back(c3);
+      if(!meet && from[1-s].count(c3)) meet = c3;
+      }
+    if(next.empty()) { println(hlog, "could not build_shortest_path"); exit(1); }
+    layer[s].swap(next);
+    }
+  vector<cell*> p;
+  for(cell *c = meet; c; c = from[0][c]) p.push_back(c);
+  reverse(p.begin(), p.end());
+  for(cell *c = from[1][meet]; c; c = from[1][c]) p.push_back(c);
+  return p;
+  }
+
 vector<cell*> build_shortest_path(cell *c1, cell *c2) {
   if(geometry == gCrystal) return crystal::build_shortest_path(c1, c2);
   vector<cell*> p;
@@ -1801,6 +2062,21 @@ vector<cell*> build_shortest_path(cell *c1, cell *c2) {
     if(isize(p) != d + 1)
       println(hlog, "warning: path size ", isize(p), " should be ", d+1);
     }
+  else if(bounded) {
+    // one distance field from the target (cached), then walk downhill
+    const distance_table& dt = distances_from(c2);
+    int d = dt.get(c1);
+    if(d < 0) { println(hlog, "could not build_shortest_path"); exit(1); }
+    p.push_back(c1);
+    while(d) {
+      forCellCM(c, c1) if(dt.get(c) == d-1) { c1 = c; goto next_bounded; }
+      println(hlog, "could not build_shortest_path"); exit(1);
+      next_bounded:
+      p.push_back(c1); d--;
+      }
+    }
+  else if(masterless || archimedean) 
+    p = bidirectional_shortest_path(c1, c2);
   else if(c2 == currentmap->gamestart()) {
     while(c1 != c2) {
       p.push_back(c1);
@@ -1815,24 +2091,41 @@ vector<cell*> build_shortest_path(cell *c1, cell *c2) {
     reverse(p.begin(), p.end());
     }
   else {
-    while(c1 != c2) {
-      p.push_back(c1);
-      forCellCM(c, c1) if(celldistance(c, c2) < celldistance(c1, c2)) { c1 = c; goto next; }
+    // a shortest path in a hyperbolic tiling climbs towards the common
+    // ancestor of both cells, possibly goes sideways, and then descends;
+    // so try the parents first while climbing, and the children afterwards.
+    // This way the first candidate is usually right, and we need about
+    // one distance evaluation per step rather than one per neighbor
+    int d = celldistance(c1, c2);
+    bool climbing = true;
+    p.push_back(c1);
+    while(d) {
+      int d0 = celldist(c1);
+      auto rank = [&] (int delta) { return delta == (climbing ? -1 : 1) ? 0 : delta == 0 ? 1 : 2; };
+      for(int phase=0; phase<3; phase++)
+        forCellCM(c, c1) {
+          int delta = celldist(c) - d0;
+          if(rank(delta) == phase && celldistance(c, c2) == d-1) {
+            if(delta >= 0) climbing = false;
+            c1 = c; goto next_tree;
+            }
+          }
       println(hlog, "could not build_shortest_path"); exit(1);
-      next: ;
+      next_tree:
+      p.push_back(c1); d--;
       }
-    p.push_back(c1);
     }
   return p;
   }
 
 void clearCellMemory() {
-  for(int i=0; i<isize(allmaps); i++) 
+  // alternate maps refer to the main map, so they go first
+  for(int i=isize(allmaps)-1; i>=0; i--)
     if(allmaps[i])
       delete allmaps[i];
   allmaps.clear();
   last_cleared = NULL;
-  saved_distances.clear();
+  clear_distance_tables();
   pd_from = NULL;
   }
 
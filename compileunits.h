@@ -42,6 +42,7 @@
 #include "yendor.cpp"
 #include "complex.cpp"
 #include "savemem.cpp"
+#include "snapshot.cpp"
 #include "game.cpp"
 #include "orbgen.cpp"
 #include "monstergen.cpp"
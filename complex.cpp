@@ -52,17 +52,16 @@ namespace whirlwind {
   cell *where;
   int dfrom[2], dto[2], qdirs;
   
-  int gdist(int d, int e) { return dirdiff(d-e, where->type); }
-  
-  void calcdirs(cell *c) {
-    where = c;
+  // find the directions from which and to which the wind blows at c, and
+  // return their number; this only reads the map (a neighbor which has not
+  // been created yet is not in the Whirlwind, just like a new cell)
+  int finddirs(cell *c, int *dfrom, int *dto) {
     int d = cat(c);
-    qdirs = 0;
-    if(d == 0) return;
+    if(d == 0) return 0;
     int qdf = 0, qdt = 0;
     int cats[MAX_EDGE];
     for(int i=0; i<c->type; i++) 
-      cats[i] = cat(createMov(c,i));
+      cats[i] = c->move(i) ? cat(c->move(i)) : 0;
     for(int i=0; i<c->type; i++)
       if(cats[i] == d) {
         bool c1 = (cats[(i+1)%c->type] != d);
@@ -70,29 +69,47 @@ namespace whirlwind {
         if(c1 && !c2) dto[qdt++] = i;
         if(c2 && !c1) dfrom[qdf++] = i;
         }
-    qdirs = qdf;
-    if(qdirs == 2) {
-      int cur = gdist(dfrom[0], dto[0]) + gdist(dfrom[1], dto[1]);
-      int alt = gdist(dfrom[0], dto[1]) + gdist(dfrom[1], dto[0]);
+    if(qdf == 2) {
+      auto gd = [c] (int d, int e) { return dirdiff(d-e, c->type); };
+      int cur = gd(dfrom[0], dto[0]) + gd(dfrom[1], dto[1]);
+      int alt = gd(dfrom[0], dto[1]) + gd(dfrom[1], dto[0]);
       if(alt < cur) swap(dto[0], dto[1]);
       }
+    return qdf;
+    }
+
+  void calcdirs(cell *c) {
+    where = c;
+    if(cat(c)) for(int i=0; i<c->type; i++) createMov(c, i);
+    qdirs = finddirs(c, dfrom, dto);
     }
 
-  int mindist(int d, int *tab) {
-    if(qdirs == 0) return NODIR;
-    if(qdirs == 1) return gdist(d, tab[0]);
-    return min(gdist(d, tab[0]), gdist(d, tab[1]));
+  int mindist(int d, int *tab, int q, int t) {
+    if(q == 0) return NODIR;
+    if(q == 1) return dirdiff(d-tab[0], t);
+    return min(dirdiff(d-tab[0], t), dirdiff(d-tab[1], t));
     }
 
-  int winddir(int d) {
+  int winddir(int d, int *dfrom, int *dto, int q, int t) {
     if(d == -1) return 0;
-    int mdf = mindist(d, dfrom);
-    int mdt = mindist(d, dto);
+    int mdf = mindist(d, dfrom, q, t);
+    int mdt = mindist(d, dto, q, t);
     // printf("dir = %d mdf = %d mdt = %d\n", d, mdf, mdt);
     if(mdf < mdt) return -1;
     if(mdf > mdt) return 1;
     return 0;
     }
+
+  // the wind in direction d at the cell given to calcdirs
+  int winddir(int d) { return winddir(d, dfrom, dto, qdirs, where->type); }
+
+  // the same for the cell c, without calcdirs: this does not change the
+  // state above or create cells, so the shmup intent threads can use it
+  int winddir(cell *c, int d) {
+    int df[2], dt[2];
+    int q = finddirs(c, df, dt);
+    return winddir(d, df, dt, q, c->type);
+    }
   
   void build(vector<cell*>& whirlline, int d) {
     again: 
@@ -371,15 +388,16 @@ namespace elec {
   void init() {
     chargecells.clear();
     if(!haveelec && !afterOrb) return;
+    charges.resize(2); 
+    charges[0].lowlink = 0; charges[1].lowlink = 1;
+    // nothing to list then (checkmove() builds this for every probe)
+    if(!havecharge) return;
+
     if(1) {
       manual_celllister cl;
       for(int i=0; i<isize(dcal); i++) listChargedCells(dcal[i], cl);
       }
     
-    charges.resize(2); 
-    charges[0].lowlink = 0; charges[1].lowlink = 1;
-    if(!havecharge) return;
-    
     xstack.clear();
     
     for(int i=0; i<isize(chargecells); i++) 
@@ -1882,7 +1900,30 @@ namespace heat {
 
   vector<cell*> offscreen_heat, offscreen_fire; // offscreen cells to take care off
 
+  // the heat scheduler: hmod is exactly 0 for an Icy cell which has no
+  // monster, fire or statue, whose Icy neighbours have the same heat and 
+  // are on the same side of the border between Cocytus and Ice/Blizzard,
+  // and whose other neighbours are not burning, volcanic, or occupied by
+  // a player; such cells are skipped (in the verify mode, they are computed
+  // anyway, and counted if hmod is not 0)
+  bool sparse = true, verify;
+  int mismatches;
+  
+  bool active(cell *c) {
+    if(c->monst || isFire(c)) return true;
+    if(c->wall == waDeadTroll || c->wall == waDeadTroll2 || c->wall == waBigStatue) return true;
+    bool coc = c->land == laCocytus;
+    forCellEx(ct, c) {
+      if(isIcyLand(ct)) {
+        if(HEAT(ct) != HEAT(c) || (ct->land == laCocytus) != coc) return true;
+        }
+      else if(isFire(ct) || ct->land == laVolcano || isPlayerOn(ct)) return true;
+      }
+    return false;
+    }
+
   void processheat(double rate = 1) {
+    profile_start(PROF_HEAT);
     if(markOrb(itOrbSpeed)) rate /= 2;
     int oldmelt = kills[0];    
     
@@ -1924,14 +1965,27 @@ namespace heat {
     
     vector<ld> hmods(dcs, 0);
     
+    // windmap::at() is slow, so the wind codes are computed at most once 
+    // per cell (indexed as in cl)
+    vector<int> winds;
+    auto wind = [&] (cell *c) {
+      cl.add(c);
+      int id = cl.index(c);
+      if(id >= isize(winds)) winds.resize(id+1, -1);
+      if(winds[id] < 0) winds[id] = windmap::at(c);
+      return winds[id];
+      };
+    
     for(int i=0; i<dcs; i++) {
       cell *c = allcells[i];
       double xrate = (c->land == laCocytus && shmup::on) ? 1/3. : 1;
       if(PURE) xrate *= 1.7; // todo-variation
       if(!shmup::on) xrate /= FIX94;
       if(c->cpdist > gr && !doall) break;
+      
+      bool quiet = sparse && isIcyLand(c) && !active(c);
   
-      if(isIcyLand(c)) {
+      if(isIcyLand(c) && (!quiet || verify)) {
         ld hmod = 0;
 
         if(c->monst == moRanger) hmod += 3 * xrate;
@@ -1977,8 +2031,8 @@ namespace heat {
           ld hdiff = absheat(ct) - absheat(c);
           hdiff /= 10;
 
-          if(ct->land == laBlizzard) {
-            int v = (windmap::at(ct) - windmap::at(c)) & 255;
+          if(hdiff && ct->land == laBlizzard) {
+            int v = (wind(ct) - wind(c)) & 255;
             if(v > 128) v -= 256;
             if(v < windmap::NOWINDFROM && v > -windmap::NOWINDFROM)
               hdiff = hdiff * (1 - v * 5. / windmap::NOWINDFROM);
@@ -1992,6 +2046,7 @@ namespace heat {
         // printf("%d ", vsum);
         
         hmods[i] = hmod;
+        if(quiet && hmod) mismatches++;
         }
       
       if(HEAT(c) && !doall)
@@ -2026,6 +2081,7 @@ namespace heat {
       }
   
     if(kills[0] != oldmelt) bfs();
+    profile_stop(PROF_HEAT);
     }
 
   vector<pair<cell*, int> > newfires;
@@ -3083,26 +3139,107 @@ namespace ca {
   auto ah = addHook(hooks_args, 0, readArg);
 #endif
 
-  void simulate() {
-    if(cwt.at->land != laCA) return;
+  // the CA engine: the neighbours of allcells() are listed once into a CSR
+  // array (adj[start[i]..start[i+1]) are the indices of the neighbours of 
+  // cells[i]), and rebuilt only when allcells() changes. Neighbours which
+  // are not in allcells() are listed after them, and they do not change. 
+  // The generations are computed on flat double-buffered states; the walls
+  // are read in prepare() and written in writeback(), so a run of many 
+  // generations (-benchca) does not touch the cells at all
+
+  struct engine {
+    hrmap *m;
+    int n;
+    vector<cell*> cells;
+    vector<int> start, adj;
+    vector<unsigned char> isca, nei, cur, next;
+    unsigned char rule[16][2][16];
+    };
+  
+  engine e;
+  
+  void invalidate() { e.m = NULL; e.cells.clear(); }
+  
+  void build() {
     vector<cell*>& allcells = currentmap->allcells();
-    int dcs = isize(allcells);
-    std::vector<bool> willlive(dcs);
-    for(int i=0; i<dcs; i++) {
-      cell *c = allcells[i];
-      if(c->land != laCA) return;
-      int nei = 0, live = 0;
-      forCellEx(c2, c) if(c2->land == laCA) {
-        nei++; if(c2->wall == waFloorA) live++;
+    e.m = currentmap;
+    e.n = isize(allcells);
+    e.start.clear(); e.adj.clear();
+    manual_celllister cl;
+    for(cell *c: allcells) cl.add(c);
+    for(int i=0; i<e.n; i++) {
+      e.start.push_back(isize(e.adj));
+      forCellEx(c2, allcells[i]) {
+        cl.add(c2);
+        e.adj.push_back(cl.index(c2));
         }
-      int welive = 0; if(c->wall == waFloorA) welive++;
-      willlive[i] = carule[nei][welive][live] == '1';
       }
-    for(int i=0; i<dcs; i++) {
-      cell *c = allcells[i];
-      c->wall = willlive[i] ? waFloorA : waNone;
+    e.start.push_back(isize(e.adj));
+    e.cells = cl.lst;
+    int q = isize(e.cells);
+    e.isca.resize(q); e.cur.resize(q); e.next.resize(q); e.nei.resize(e.n);
+    }
+  
+  // false if not all of allcells() are in the CA land
+  bool prepare() {
+    vector<cell*>& allcells = currentmap->allcells();
+    if(e.m != currentmap || e.n != isize(allcells) || !std::equal(allcells.begin(), allcells.end(), e.cells.begin()))
+      build();
+    for(int i=0; i<e.n; i++) if(e.cells[i]->land != laCA) return false;
+    for(int i=0; i<isize(e.cells); i++) {
+      cell *c = e.cells[i];
+      e.isca[i] = c->land == laCA;
+      e.cur[i] = e.isca[i] && c->wall == waFloorA;
+      }
+    for(int i=0; i<e.n; i++) {
+      int nei = 0;
+      for(int j=e.start[i]; j<e.start[i+1]; j++) nei += e.isca[e.adj[j]];
+      e.nei[i] = min(nei, 15);
+      }
+    // the rules are only given up to 7 neighbours; cells with more die
+    for(int nei=0; nei<16; nei++) for(int l=0; l<2; l++) for(int live=0; live<16; live++)
+      e.rule[nei][l][live] = nei < 8 && live < 8 && carule[nei][l][live] == '1';
+    e.next = e.cur;
+    return true;
+    }
+  
+  void step(int from, int to) {
+    const int *start = &e.start[0], *adj = &e.adj[0];
+    const unsigned char *cur = &e.cur[0];
+    unsigned char *next = &e.next[0];
+    for(int i=from; i<to; i++) {
+      int live = 0;
+      for(int j=start[i]; j<start[i+1]; j++) live += cur[adj[j]];
+      next[i] = e.rule[e.nei[i]][cur[i]][min(live, 15)];
       }
     }
+  
+  void step() {
+#if CAP_THREADS
+    int k = std::thread::hardware_concurrency();
+    if(k > 1 && e.n >= 65536) {
+      vector<std::thread> threads;
+      for(int t=0; t<k; t++)
+        threads.emplace_back([t, k] { step(e.n * (long long) t / k, e.n * (long long) (t+1) / k); });
+      for(auto& th: threads) th.join();
+      }
+    else
+#endif
+    step(0, e.n);
+    swap(e.cur, e.next);
+    }
+  
+  void writeback() {
+    for(int i=0; i<e.n; i++)
+      e.cells[i]->wall = e.cur[i] ? waFloorA : waNone;
+    }
+
+  void simulate() {
+    if(cwt.at->land != laCA) return;
+    if(!prepare()) return;
+    step();
+    writeback();
+    }
   }
 
 auto ccm = addHook(clearmemory, 0, [] () {
@@ -3118,8 +3255,10 @@ auto ccm = addHook(clearmemory, 0, [] () {
   prairie::tchoices.clear();
   prairie::beaststogen.clear();
   mirror::clearcache();
+  ca::invalidate();
   }) +
   addHook(hooks_removecells, 0, [] () {
+    ca::invalidate();
     eliminate_if(heat::offscreen_heat, is_cell_removed);
     eliminate_if(heat::offscreen_fire, is_cell_removed);
     eliminate_if(princess::infos, [] (princess::info*& i) { 
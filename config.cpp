@@ -166,6 +166,8 @@ void initConfig() {
   addsaver(vid.graphglyph, "graphical items/kills", 1);
   addsaver(vid.particles, "extra effects", 1);
   addsaver(vid.framelimit, "frame limit", 75);
+  addsaver(shmup::fixedstep::length, "shmup step length", 0);
+  addsaver(shmup::fixedstep::maxsteps, "shmup steps per frame", 4);
   addsaver(vid.xres, "xres");
   addsaver(vid.yres, "yres");
   addsaver(vid.fsize, "font size");
@@ -195,6 +197,9 @@ void initConfig() {
   addsaver(geom3::gp_autoscale_heights, "3D Goldberg autoscaling");
   
   addsaver(memory_saving_mode, "memory_saving_mode", (ISMOBILE || ISPANDORA || ISWEB) ? 1 : 0);
+  addsaver(memory_budget, "memory_budget", 0);
+  addsaver(memory_time_slice, "memory_time_slice", 10);
+  addsaver(pregen_time_slice, "pregen_time_slice", 0);
 
   addsaver(rug::renderonce, "rug-renderonce");
   addsaver(rug::rendernogl, "rug-rendernogl");
@@ -1776,6 +1781,15 @@ int read_config_args() {
   else if(argis("-msmoff")) {
     PHASEFROM(2); memory_saving_mode = false;
     }
+  else if(argis("-msmbudget")) {
+    PHASEFROM(2); shift(); memory_budget = argi();
+    }
+  else if(argis("-msmslice")) {
+    PHASEFROM(2); shift(); memory_time_slice = argi();
+    }
+  else if(argis("-pregen")) {
+    PHASEFROM(2); shift(); pregen_time_slice = argi();
+    }
   TOGGLE('o', vid.usingGL, switchGL())
   TOGGLE('f', vid.full, switchFullscreen())
   else if(argis("-d:sight")) {
@@ -1056,6 +1056,102 @@ namespace conformal {
 #endif
     }
 
+  // input log: the seed of a game and its inputs (moves and ranged orb uses),
+  // each with the direction the player was facing (which the interface 
+  // may change freely, and movepcto is relative to it) and a hash of the 
+  // game state after it; -replay executes them again with the same seed, 
+  // and reports the first input after which the hash is different. 
+  // Inputs caused by other inputs are not recorded
+  
+  FILE *inputlog;
+  int inputdepth;
+  
+  unsigned statehash() {
+    unsigned h = turncount;
+    auto mix = [&] (unsigned x) { h = h * 1000003 + x; };
+    std::mt19937 r = hrngen; mix(r());
+    for(cell *c: dcal) mix(c->land), mix(c->wall), mix(c->monst), mix(c->item), mix(c->cpdist);
+    for(int i=0; i<ittypes; i++) mix(items[i]);
+    mix(cwt.spin); mix(canmove);
+    return h;
+    }
+  
+  input_recorder::input_recorder(char t, int x, int y, bool checkonly) : type(t), a(x), b(y) {
+    spin = cwt.spin; mirrored = cwt.mirrored;
+    active = inputlog && !inputdepth && !checkonly;
+    inputdepth++;
+    }
+  
+  input_recorder::~input_recorder() {
+    inputdepth--;
+    if(active && inputlog) {
+      fprintf(inputlog, "%c %d %d %d %d %08x\n", type, a, b, spin, mirrored, statehash());
+      fflush(inputlog);
+      }
+    }
+  
+  int dcal_index(cell *c) {
+    if(!inputlog || inputdepth) return -1;
+    for(int i=0; i<isize(dcal); i++) if(dcal[i] == c) return i;
+    return -1;
+    }
+  
+  void restart_with_seed(int seed) {
+    stop_game(); 
+    // havewhat from the previous game affects the land generation
+    havewhat = hadwhat = 0;
+    shrand(seed);
+    start_game();
+    }
+  
+  void record(const string& fname) {
+    if(shmup::on || multi::players > 1) {
+      printf("input logs are recorded only in the single player turn-based mode\n");
+      return;
+      }
+    int seed = fixseed ? startseed : time(NULL);
+    restart_with_seed(seed);
+    inputlog = fopen(fname.c_str(), "wt");
+    if(!inputlog) { printf("cannot write %s\n", fname.c_str()); return; }
+    fprintf(inputlog, "HyperRogue input log %s\n", VER);
+    fprintf(inputlog, "%d %d %d %d\n", seed, int(geometry), int(variation), int(specialland));
+    fprintf(inputlog, "s 0 0 %d %d %08x\n", cwt.spin, cwt.mirrored, statehash());
+    fflush(inputlog);
+    }
+  
+  void replay(const string& fname) {
+    FILE *f = fopen(fname.c_str(), "rt");
+    if(!f) { printf("cannot read %s\n", fname.c_str()); return; }
+    char ver[64];
+    int seed, geo, var, land;
+    if(fscanf(f, "HyperRogue input log %63s %d %d %d %d", ver, &seed, &geo, &var, &land) != 5) {
+      printf("%s is not an input log\n", fname.c_str()); fclose(f); return;
+      }
+    if(geo != int(geometry) || var != int(variation) || land != int(specialland)) {
+      printf("this log needs -geo %d, variation %d and -W %s\n", geo, var, linf[land].name);
+      fclose(f); return;
+      }
+    if(strcmp(ver, VER)) printf("warning: this log was recorded by HyperRogue %s\n", ver);
+    FILE *saved = inputlog; inputlog = NULL;
+    restart_with_seed(seed);
+    int t0 = SDL_GetTicks();
+    int q = 0, bad = -1;
+    char type; int a, b, spin, mirrored; unsigned h;
+    while(fscanf(f, " %c %d %d %d %d %x", &type, &a, &b, &spin, &mirrored, &h) == 6) {
+      cwt.spin = spin; cwt.mirrored = mirrored;
+      if(type == 'm') movepcto(a, b);
+      else if(type == 'o' && a >= 0 && a < isize(dcal)) targetRangedOrb(dcal[a], orbAction(b));
+      if(statehash() != h) { bad = q; break; }
+      if(type != 's') q++;
+      }
+    fclose(f);
+    inputlog = saved;
+    if(bad >= 0)
+      printf("replay: divergence at input %d (turn %d)\n", bad+1, turncount);
+    else
+      printf("replay: %d inputs, %d turns, %d ms, no divergence\n", q, turncount, SDL_GetTicks() - t0);
+    }
+
   #if CAP_COMMANDLINE
   int readArgs() {
     using namespace arg;
@@ -1113,6 +1209,12 @@ namespace conformal {
     else if(argis("-alpha")) { 
       PHASEFROM(2); shift_arg_formula(vid.alpha);
       }
+    else if(argis("-record")) {
+      PHASEFROM(3); shift(); record(args());
+      }
+    else if(argis("-replay")) {
+      PHASEFROM(3); shift(); replay(args());
+      }
     else if(argis("-d:model")) 
       launch_dialog(model_menu);
     else if(argis("-d:formula")) {
@@ -1137,6 +1239,7 @@ namespace conformal {
     conformal::findhistory.clear();
     conformal::movehistory.clear();
     conformal::includeHistory = false;
+    if(conformal::inputlog) fclose(conformal::inputlog), conformal::inputlog = NULL;
     });
 
   }
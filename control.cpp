@@ -500,7 +500,15 @@ void mainloopiter() {
   
   bool normal = cmode & sm::NORMAL;
 
-  shmup::turn(ticks - lastt);
+  shmup::advance(ticks - lastt);
+  
+  if(!shmup::on && memory_saver_busy()) continue_memory_saving();
+
+  bool pregen_replayable = !conformal::inputlog || (position_rng && position_rng_supported());
+  if(!shmup::on && normal && pregen_time_slice && timetowait > 0 && pregen_replayable && pregen::busy()) {
+    pregen::work(min(timetowait, pregen_time_slice));
+    timetowait = lastt + 1000 / cframelimit - int(SDL_GetTicks());
+    }
     
   if(!shmup::on && (multi::alwaysuse || multi::players > 1) && normal)
     timetowait = 0, multi::handleMulti(ticks - lastt);
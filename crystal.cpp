@@ -388,7 +388,7 @@ struct hrmap_crystal : hrmap {
     }
 
   ~hrmap_crystal() {
-    clearfrom(getOrigin());
+    if(!bulk_release()) clearfrom(getOrigin());
     }
   
   heptagon *get_heptagon_at(coord c, int deg) {
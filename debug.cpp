@@ -270,7 +270,7 @@ bool applyCheat(char u, cell *c = NULL) {
   if(u == 'L'-64) {
     cell *c = mouseover;
     describeCell(c);
-    printf("Neighbors:"); for(int i=0; i<c->type; i++) printf("%p ",  c->move(i));
+    printf("Neighbors:"); for(int i=0; i<c->type; i++) printf("%p ",  (void*) c->move(i));
     printf("Barrier: dir=%d left=%d right=%d\n",
       c->bardir, c->barleft, c->barright);
     return true;
@@ -450,6 +450,121 @@ void raiseBuggyGeneration(cell *c, const char *s) {
     c->item = itBuggy;
   }
 
+// resident set size in KB, or -1 if unknown
+int resident_kb() {
+#if ISLINUX
+  FILE *f = fopen("/proc/self/status", "r");
+  if(!f) return -1;
+  char buf[256];
+  int res = -1;
+  while(fgets(buf, 256, f))
+    if(sscanf(buf, "VmRSS: %d", &res) == 1) break;
+  fclose(f);
+  return res;
+#else
+  return -1;
+#endif
+  }
+
+// make one random move (or wait, if no move is possible); false if even
+// waiting is not possible. Without policy, up to 20 random directions are 
+// tried with hrand, so the game depends only on the seed; with policy, a 
+// legal direction is chosen with it, which leaves hrand to the game
+
+bool random_turn(std::mt19937 *policy = NULL) {
+  bool moved = false;
+  if(policy) {
+    vector<int> dirs;
+    for(int d=0; d<cwt.at->type; d++)
+      if(movepcto((d - cwt.spin + cwt.at->type) % cwt.at->type, 1, true))
+        dirs.push_back(d);
+    if(isize(dirs)) {
+      int d = dirs[(*policy)() % isize(dirs)];
+      movepcto((d - cwt.spin + cwt.at->type) % cwt.at->type, 1, true);
+      moved = movepcto(0, 1);
+      }
+    }
+  else for(int k=0; k<20 && !moved; k++) {
+    int d = hrand(cwt.at->type);
+    if(movepcto((d - cwt.spin + cwt.at->type) % cwt.at->type, 1, true))
+      moved = movepcto(0, 1);
+    }
+  return moved || movepcto(-1, 1);
+  }
+
+// play up to q random turns, calling before_turn and after_turn (if given)
+// around each of them; returns the number of turns played
+
+int play_random_turns(int q, const function<void()>& after_turn, std::mt19937 *policy = NULL, const function<void()>& before_turn = nullptr) {
+  int t = 0;
+  for(; t<q && canmove; t++) {
+    if(before_turn) before_turn();
+    if(!random_turn(policy)) break;
+    if(after_turn) after_turn();
+    }
+  return t;
+  }
+
+// the differential checks play the same random game from startseed in 
+// two modes, and compare a digest of the state after every turn
+
+struct diffcheck {
+  array<int, ittypes> start_items;
+  vector<unsigned> digests[2];
+  unsigned h;
+  int diff, first;
+
+  // the first game after the start differs from the later ones
+  diffcheck() : start_items(items) { start_game(); stop_game(); }
+
+  // havewhat from the previous game affects the land generation; 
+  // the items given with -I are kept
+  void restart() {
+    stop_game(); havewhat = hadwhat = 0; shrand(startseed); items = start_items; start_game();
+    }
+
+  void mix(unsigned x) { h = h * 1000003 + x; }
+
+  // play q random turns, calling digest() to mix the state after each
+  void play(int q, int mode, const function<void()>& digest) {
+    play_random_turns(q, [&] { h = 0; digest(); digests[mode].push_back(h); });
+    }
+
+  void compare() {
+    diff = 0, first = -1;
+    for(int t=0; t<min(isize(digests[0]), isize(digests[1])); t++) 
+      if(digests[0][t] != digests[1][t]) { diff++; if(first < 0) first = t; }
+    }
+  };
+
+// play q turns in the current game, moving in a random legal direction
+// (or waiting), and print the results as JSON; the time per phase is 
+// included when compiled with CAP_PROFILING. The directions are chosen 
+// with a separate generator, so the games can be recorded with -record
+
+void benchturns(int q) {
+  profile_frame();
+  auto t0 = std::chrono::steady_clock::now();
+  std::mt19937 policy(startseed);
+  tide_checks = air_cells = rose_cells = 0;
+  int t = play_random_turns(q, nullptr, &policy);
+  double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+  static const char *varnames[] = {"bitruncated", "pure", "goldberg", "irregular", "dual"};
+  printf("{\"land\": \"%s\", \"geometry\": \"%s\", \"variation\": \"%s\", \"seed\": %d, ",
+    linf[specialland].name, ginf[geometry].name, varnames[int(variation)], startseed);
+  printf("\"turns\": %d, \"seconds\": %.3f, \"turns_per_sec\": %.1f, \"cells\": %d, \"alive\": %s",
+    t, secs, t / max(secs, 1e-9), cellcount, canmove ? "true" : "false");
+  printf(", \"fixpoint\": {\"tide\": %d, \"air\": %d, \"rose\": %d}", tide_checks, air_cells, rose_cells);
+#if CAP_PROFILING
+  static const char *catnames[] = {"bfs", "movemonsters", "heat", "setdist", "checkmove"};
+  printf(", \"ms\": {");
+  for(int c=PROF_BFS; c<=PROF_CHECKMOVE; c++)
+    printf("%s\"%s\": %.1f", c == PROF_BFS ? "" : ", ", catnames[c-PROF_BFS], proftable[c][pframeid] / 1000.);
+  printf("}");
+#endif
+  printf("}\n");
+  }
+
 #if CAP_COMMANDLINE
 
 int read_cheat_args() {
@@ -549,13 +664,347 @@ int read_cheat_args() {
   else if(argis("-top")) {
     PHASE(3); View = View * spin(-M_PI/2);
     }
+  else if(argis("-genthreads")) {
+    shift(); genlayers::threads = argi();
+    }
+  else if(argis("-genlayers")) {
+    // example: hyper -nogui -genthreads 4 -genlayers 14 -gencells 1000000 -exit
+    PHASEFROM(2); shift(); start_game();
+    if(!genlayers::available()) { printf("-genlayers: not available in this geometry\n"); exit(1); }
+    int t0 = SDL_GetTicks();
+    auto layers = genlayers::generate(argi());
+    int t1 = SDL_GetTicks();
+    int q = 0;
+    for(auto& l: layers) q += isize(l);
+    printf("%d layers, %d heptagons, %d ms (serial %.0f ms, parallel %.0f ms), %.0f heptagons/s, digest %08x\n",
+      isize(layers), q, t1-t0, genlayers::sertime * 1000, genlayers::partime * 1000, q * 1000. / max(t1-t0, 1),
+      genlayers::digest(layers));
+    }
   else if(argis("-gencells")) {
     PHASEFROM(2); shift(); start_game();
     printf("Generating %d cells...\n", argi());
+    int t0 = SDL_GetTicks();
     celllister cl(cwt.at, 50, argi(), NULL);
+    int t1 = SDL_GetTicks();
     printf("Cells generated: %d\n", isize(cl.lst));
     for(int i=0; i<isize(cl.lst); i++)
       setdist(cl.lst[i], 7, NULL);
+    int t2 = SDL_GetTicks();
+    printf("listing: %d ms, setdist: %d ms, %d cells in memory, %.0f cells/s\n", 
+      t1-t0, t2-t1, cellcount, cellcount * 1000. / max(t2-t0, 1));
+    }
+  else if(argis("-benchbfs")) {
+    // example: hyper -srx 10 -benchbfs 1000
+    PHASEFROM(2); shift(); start_game();
+    int q = argi();
+    int t0 = SDL_GetTicks();
+    for(int i=0; i<q; i++) bfs();
+    int t1 = SDL_GetTicks();
+    printf("bfs: %d cells, %.3f ms per call\n", isize(dcal), (t1-t0) * 1. / q);
+    }
+  else if(argis("-benchca")) {
+    // example: hyper -nogui -tparx 3,1000,1000 -geo 6 -W Cellular -benchca 100 -exit
+    PHASEFROM(2); shift(); start_game();
+    int q = argi();
+    // the starting land does not spread in quotient spaces, so fill them
+    for(cell *c: currentmap->allcells()) if(!c->land) {
+      c->land = specialland;
+      c->wall = (hrand(1000000) < ca::prob * 1000000) ? waFloorA : waNone;
+      }
+    if(!ca::prepare()) { printf("not all cells are in the CA land\n"); exit(1); }
+    int t0 = SDL_GetTicks();
+    for(int i=0; i<q; i++) ca::step();
+    int t1 = SDL_GetTicks();
+    ca::writeback();
+    int live = 0; unsigned hash = 0;
+    for(cell *c: currentmap->allcells()) {
+      hash = hash * 3 + (c->wall == waFloorA);
+      if(c->wall == waFloorA) live++;
+      }
+    printf("ca: %d cells, %d live, hash %08x, %.3f ms per generation, %.2f generations/s\n",
+      ca::e.n, live, hash, (t1-t0) * 1. / q, q * 1000. / max(t1-t0, 1));
+    }
+  else if(argis("-benchpath")) {
+    // example: hyper -geo 4 -benchpath 1000 10
+    PHASEFROM(2); shift(); start_game();
+    int q = argi(); shift(); int r = argi();
+    celllister cl(cwt.at, r, 1000000, NULL);
+    vector<cell*> lst = cl.lst;
+    vector<pair<cell*, cell*>> pairs;
+    for(int i=0; i<q; i++) pairs.emplace_back(lst[hrand(isize(lst))], lst[hrand(isize(lst))]);
+    int t0 = SDL_GetTicks();
+    long long total = 0;
+    for(auto& p: pairs) total += isize(build_shortest_path(p.first, p.second));
+    int t1 = SDL_GetTicks();
+    int bad = 0;
+    for(auto& p: pairs) {
+      int d = celldistance(p.first, p.second);
+      // 64 means that celldistance does not know
+      if(d < 64 && isize(build_shortest_path(p.first, p.second)) != d + 1) bad++;
+      }
+    printf("paths: %d, average length %.2f, %.3f ms per path, %d wrong lengths\n", 
+      q, total * 1. / q, (t1-t0) * 1. / q, bad);
+    }
+  else if(argis("-bfsinc")) {
+    shift(); incremental_bfs = argi();
+    }
+  else if(argis("-bfsdiff")) {
+    // play the same random game in the full and in the incremental bfs() mode,
+    // and compare the results after every turn
+    // example: hyper -fixx 1 -bfsdiff 1000
+    PHASEFROM(2); shift(); int q = argi();
+    diffcheck dc;
+    bool saved = incremental_bfs;
+    for(int mode: {0, 1}) {
+      incremental_bfs = mode;
+      dc.restart();
+      bfs_repairs = 0;
+      dc.play(q, mode, [&] {
+        dc.mix(havewhat);
+        for(cell *c: dcal) dc.mix(c->cpdist), dc.mix(c->land), dc.mix(c->wall), dc.mix(c->monst), dc.mix(c->item);
+        for(auto v: {&worms, &ivies, &ghosts, &golems, &targets, &hexsnakes}) {
+          dc.mix(isize(*v));
+          for(cell *c: *v) dc.mix(c->cpdist);
+          }
+        dc.mix(isize(airmap)); dc.mix(first7);
+        });
+      }
+    incremental_bfs = saved;
+    dc.compare();
+    printf("bfsdiff: %d/%d turns, %d repaired bfs calls, %d differences (first at turn %d)\n", 
+      isize(dc.digests[0]), isize(dc.digests[1]), bfs_repairs, dc.diff, dc.first);
+    }
+  else if(argis("-fixpoint")) {
+    shift(); worklist_fixpoint = argi();
+    }
+  else if(argis("-fixdiff")) {
+    // play the same random game with the tides and the rose scent propagated
+    // by full sweeps and by worklists, and compare the results after every
+    // turn; also print the number of cells processed by these passes; the
+    // items given with -I are kept (the chaos mode Ocean needs them)
+    // example: hyper -fixx 1 -W Rose -fixdiff 1000
+    // example: hyper -fixx 1 -C -ch -I Shield 100000 -I Pearl 30 -fixdiff 1000
+    PHASEFROM(3); shift(); int q = argi();
+    diffcheck dc;
+    double secs[2];
+    int checks[2][3];
+    bool saved = worklist_fixpoint;
+    for(int mode: {0, 1}) {
+      worklist_fixpoint = mode;
+      dc.restart();
+      tide_checks = air_cells = rose_cells = 0;
+      auto t0 = std::chrono::steady_clock::now();
+      dc.play(q, mode, [&] {
+        dc.mix(havewhat);
+        for(cell *c: dcal) dc.mix(c->wall), dc.mix(c->land == laOcean ? c->landparam : 0);
+        for(cell *c: dcal) dc.mix(rosemap.count(c) ? rosemap[c] : -1);
+        dc.mix(isize(rosemap));
+        dc.mix(rosephase); dc.mix(rosewave);
+        });
+      secs[mode] = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+      checks[mode][0] = tide_checks; checks[mode][1] = air_cells; checks[mode][2] = rose_cells;
+      }
+    worklist_fixpoint = saved;
+    dc.compare();
+    printf("fixdiff: %d/%d turns, %.3f/%.3f s, tide %d/%d, air %d/%d, rose %d/%d cells, %d differences (first at turn %d)\n", 
+      isize(dc.digests[0]), isize(dc.digests[1]), secs[0], secs[1], checks[0][0], checks[1][0], 
+      checks[0][1], checks[1][1], checks[0][2], checks[1][2], dc.diff, dc.first);
+    }
+  else if(argis("-heatsched")) {
+    shift(); heat::sparse = argi();
+    }
+  else if(argis("-heatdiff")) {
+    // play the same random game with and without the heat scheduler, and
+    // compare the heat values after every turn; the scheduled game is 
+    // played in the verify mode, which also counts the skipped cells 
+    // that would have changed
+    // example: hyper -fixx 1 -srx 3 -W Cocytus -heatdiff 500
+    PHASEFROM(2); shift(); int q = argi();
+    diffcheck dc;
+    double secs[2];
+    bool saved = heat::sparse;
+    heat::mismatches = 0;
+    for(int mode: {0, 1, 2}) {
+      heat::sparse = mode; heat::verify = mode == 2;
+      dc.restart();
+      if(mode == 2) { play_random_turns(q, nullptr); continue; }
+      auto t0 = std::chrono::steady_clock::now();
+      dc.play(q, mode, [&] {
+        for(cell *c: dcal) if(isIcyLand(c)) {
+          float f = HEAT(c); unsigned u; memcpy(&u, &f, sizeof(u));
+          dc.mix(u); dc.mix(c->wall);
+          }
+        dc.mix(isize(heat::offscreen_heat));
+        });
+      secs[mode] = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+      }
+    heat::sparse = saved; heat::verify = false;
+    dc.compare();
+    printf("heatdiff: %d/%d turns, %.3f/%.3f s, %d differences (first at turn %d), %d mismatches\n", 
+      isize(dc.digests[0]), isize(dc.digests[1]), secs[0], secs[1], dc.diff, dc.first, heat::mismatches);
+    }
+  else if(argis("-benchheat")) {
+    // call heat::processheat() N times with and without the scheduler,
+    // starting from the same state, and compare the times and the results
+    // example: hyper -fixx 1 -srx 5 -W Cocytus -benchturns 30 -benchheat 1000
+    PHASEFROM(3); shift(); int q = argi();
+    struct cellstate { cell *c; float heat; eWall wall; eMonster monst; };
+    vector<cellstate> saved;
+    for(cell *c: dcal) saved.push_back({c, HEAT(c), c->wall, c->monst});
+    for(cell *c: heat::offscreen_heat) saved.push_back({c, HEAT(c), c->wall, c->monst});
+    auto saved_offscreen = heat::offscreen_heat;
+    int saved_melt = kills[0];
+    bool saved_sparse = heat::sparse;
+    double secs[2];
+    unsigned digest[2];
+    for(int mode: {0, 1}) {
+      for(auto& s: saved) HEAT(s.c) = s.heat, s.c->wall = s.wall, s.c->monst = s.monst;
+      heat::offscreen_heat = saved_offscreen; kills[0] = saved_melt;
+      bfs();
+      heat::sparse = mode;
+      auto t0 = std::chrono::steady_clock::now();
+      for(int i=0; i<q; i++) heat::processheat();
+      secs[mode] = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+      unsigned h = 0;
+      for(auto& s: saved) {
+        float f = HEAT(s.c); unsigned u; memcpy(&u, &f, sizeof(u));
+        h = h * 1000003 + u;
+        }
+      digest[mode] = h;
+      }
+    heat::sparse = saved_sparse;
+    printf("processheat: %d cells, %.3f ms without and %.3f ms with the scheduler, results %s\n",
+      isize(dcal), secs[0] * 1000 / q, secs[1] * 1000 / q, digest[0] == digest[1] ? "identical" : "DIFFERENT");
+    }
+  else if(argis("-threatmap")) {
+    shift(); threats::enabled = argi();
+    }
+  else if(argis("-benchcheck")) {
+    // play a random game, and after every turn probe all the moves with
+    // checkmove(), with and without the threat map (and once in the verify 
+    // mode); compare the times and the results
+    // example: hyper -W Storms -I Psi 10 -I Frog 10 -benchcheck 100
+    PHASEFROM(3); shift();
+    int q = argi();
+    dynamicval<int> mcs(vid.mobilecompasssize, 30);
+    bool saved = threats::enabled;
+    double total[2] = {0, 0};
+    int calls = 0, diff = 0;
+    threats::mismatches = 0;
+    int t = play_random_turns(q, nullptr, NULL, [&] {
+      bool legal[2][MAX_EDGE+1];
+      for(int mode: {0, 1}) {
+        threats::enabled = mode;
+        auto t0 = std::chrono::steady_clock::now();
+        for(int r=0; r<5; r++) checkmove();
+        total[mode] += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t0).count();
+        for(int i=0; i<=MAX_EDGE; i++) legal[mode][i] = legalmoves[i];
+        }
+      calls += 5;
+      for(int i=0; i<=MAX_EDGE; i++) if(legal[0][i] != legal[1][i]) { diff++; break; }
+      threats::verify = true; checkmove(); threats::verify = false;
+      });
+    threats::enabled = saved;
+    printf("checkmove: %d turns, %.3f ms without and %.3f ms with the threat map, %d differences, %d mismatches\n",
+      t, total[0] / max(calls, 1), total[1] / max(calls, 1), diff, threats::mismatches);
+    }
+  else if(argis("-benchturns")) {
+    // example: hyper -nogui -fixx 1 -W Ocean -benchturns 1000 -exit
+    PHASEFROM(3); shift(); benchturns(argi());
+    }
+  else if(argis("-benchpregen")) {
+    // play N random moves (as in -benchturns) twice: without speculative 
+    // generation, and with B ms of it after every move (emulating the idle
+    // time); compare the setdist calls and the time of the generation in
+    // afterplayermoved(). The games differ, since -pregen changes the order 
+    // of the world generation
+    // example: hyper -nogui -fixx 1 -W Crossroads -benchpregen 500 50 -exit
+    PHASEFROM(3); shift(); int q = argi(); shift(); int budget = argi();
+    for(int b: {0, budget}) {
+      conformal::restart_with_seed(startseed);
+      pregen::reset_stats();
+      std::mt19937 policy(startseed);
+      play_random_turns(q, nullptr, &policy, [b] { if(b) pregen::work(b); });
+      vector<int> us = pregen::move_us;
+      sort(us.begin(), us.end());
+      int n = isize(us);
+      long long total = 0;
+      for(int u: us) total += u;
+      printf("pregen %d ms: %d moves, %d setdist calls in moves (%.1f per move), %d in pregeneration (%d ms); "
+        "generation per move: mean %.3f ms, p99 %.3f ms, max %.3f ms\n",
+        b, n, pregen::critical_calls, pregen::critical_calls * 1. / max(n, 1), pregen::calls, pregen::total_ms,
+        total / 1000. / max(n, 1), n ? us[n * 99 / 100] / 1000. : 0, n ? us[n-1] / 1000. : 0);
+      }
+    }
+#if CAP_BATCH
+  else if(argis("-batch")) {
+    // play N games of T turns (as in -benchturns) with the seeds startseed, 
+    // startseed+1, ..., in P processes at once
+    // example: hyper -nogui -W Ocean -batch 100 500 4 -exit
+    PHASEFROM(3); 
+    shift(); int n = argi(); shift(); int q = argi(); shift(); int p = argi();
+    int seed0 = startseed;
+    // these are not real games: restart_with_seed stops the game, which
+    // would save the score, and achievements are logged to the score file
+    autocheat = true;
+    fflush(stdout);
+    auto t0 = std::chrono::steady_clock::now();
+    vector<pid_t> children;
+    for(int k=0; k<p; k++) {
+      pid_t pid = fork();
+      if(pid < 0) { printf("fork failed\n"); break; }
+      if(pid == 0) {
+        scorefile = "/dev/null";
+        for(int i=k; i<n; i+=p) {
+          startseed = seed0 + i;
+          conformal::restart_with_seed(startseed);
+          benchturns(q);
+          fflush(stdout);
+          }
+        _exit(0);
+        }
+      children.push_back(pid);
+      }
+    for(pid_t pid: children) waitpid(pid, NULL, 0);
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    printf("batch: %d games in %d processes, %.3f s\n", n, isize(children), secs);
+    }
+#endif
+  else if(argis("-benchgen")) {
+    // compare with a build using -DNO_SLAB_ARENA
+    PHASEFROM(2); shift(); start_game();
+    int rss0 = resident_kb();
+    int t0 = SDL_GetTicks();
+    if(true) {
+      celllister cl(cwt.at, 50, argi(), NULL);
+      for(int i=0; i<isize(cl.lst); i++)
+        setdist(cl.lst[i], 7, NULL);
+      }
+    int t1 = SDL_GetTicks();
+    int rss1 = resident_kb();
+    int cc = cellcount, hc = heptacount;
+    stop_game();
+    int t2 = SDL_GetTicks();
+    printf("cells: %d heptagons: %d\n", cc, hc);
+    printf("generate: %d ms, RSS +%d KB\n", t1-t0, rss1-rss0);
+    printf("release: %d ms, RSS after: %d KB\n", t2-t1, resident_kb());
+    }
+  else if(argis("-testpushpop")) {
+    // push the game, start another one, pop, generate N cells in the restored
+    // game and stop; the new cells have to be in the arena of the restored
+    // map, since the map of the other game is released first
+    // example: hyper -nogui -testpushpop 100000 -exit
+    PHASEFROM(2); shift(); int n = argi(); start_game();
+    push_game(); start_game(); pop_game();
+    celllister cl(cwt.at, 50, n, NULL);
+    for(int i=0; i<isize(cl.lst); i++)
+      setdist(cl.lst[i], 7, NULL);
+    int wrong = 0;
+    #ifndef NO_SLAB_ARENA
+    for(cell *c: cl.lst) if(slab_arena::owner(c) != currentmap->arena) wrong++;
+    #endif
+    stop_game();
+    printf("push/pop: %d cells, %d outside of the arena of the restored map\n", isize(cl.lst), wrong);
     }
   else if(argis("-sr")) {    
     PHASEFROM(2);
@@ -592,6 +1041,10 @@ int read_cheat_args() {
     fixseed = true; autocheat = true;
     shift(); startseed = argi();
     }
+  else if(argis("-posrng")) {
+    PHASEFROM(2); stop_game();
+    position_rng = true;
+    }
   else if(argis("-steplimit")) {
     fixseed = true; autocheat = true;
     shift(); steplimit = argi();
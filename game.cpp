@@ -153,14 +153,78 @@ void shrand(int i) {
   hrngen.seed(i);
   }
 
-int hrandpos() { return hrngen() & HRANDMAX; }
+// position-keyed world generation (opt-in, -posrng): random decisions made 
+// while generating a cell come from a counter-based stream keyed by 
+// (world_seed, position of the cell, generation stage), rather than from 
+// hrngen; thus they do not depend on the order in which the world is explored
+// (this is what allows -pregen while recording with -record)
+
+bool position_rng = false;
+unsigned long long world_seed;
+
+keyed_stream *active_stream;
+
+unsigned long long splitmix64(unsigned long long x) {
+  x += 0x9E3779B97F4A7C15ull;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+  return x ^ (x >> 31);
+  }
+
+bool position_rng_supported() {
+  if(euclid) return true;
+  return hyperbolic && !quotient && !binarytiling && !archimedean && geometry != gCrystal && (PURE || BITRUNCATED);
+  }
+
+// the path from the origin in the heptagon tree
+unsigned long long heptagon_code(heptagon *h) {
+  unsigned long long code = 0;
+  while(h->distance > 0 && h->move(0)) {
+    code = splitmix64(code ^ h->c.spin(0));
+    h = h->move(0);
+    }
+  return code;
+  }
+
+unsigned long long position_code(cell *c) {
+  if(euclid) return splitmix64(cell_to_vec(c));
+  if(c == c->master->c7) return heptagon_code(c->master);
+  // the master of a hexagon depends on which heptagon created it,
+  // so use all three adjacent heptagons, in an order-independent way
+  unsigned long long code = 1;
+  for(int i=0; i<c->type; i+=2) 
+    code += splitmix64(heptagon_code(c->move(i)->master));
+  return code;
+  }
+
+position_rng_guard::position_rng_guard(cell *c, int purpose) {
+  saved = active_stream;
+  if(!position_rng || !position_rng_supported()) return;
+  active_stream = &stream;
+  stream.key = splitmix64(world_seed ^ splitmix64(position_code(c) + purpose));
+  stream.counter = 0;
+  }
+
+position_rng_guard::~position_rng_guard() {
+  active_stream = saved;
+  }
+
+unsigned hrand_raw() {
+  if(active_stream)
+    return splitmix64(active_stream->key + active_stream->counter++) >> 32;
+  return hrngen() - hrngen.min();
+  }
+
+static const long long hrand_range = 1ll << 32;
+
+int hrandpos() { return hrand_raw() & HRANDMAX; }
 
 // using our own implementations rather than ones from <random>,
 // to make sure that they return the same values on different compilers
 
 int hrand(int i) { 
-  unsigned d = hrngen() - hrngen.min();
-  long long m = (long long) (hrngen.max() - hrngen.min()) + 1;
+  unsigned d = hrand_raw();
+  long long m = hrand_range;
   m /= i;
   d /= m;
   if(d < (unsigned) i) return d;
@@ -168,10 +232,12 @@ int hrand(int i) {
   }
 
 ld hrandf() { 
-  return (hrngen() - hrngen.min()) / (hrngen.max() + 1.0 - hrngen.min());
+  return hrand_raw() / ld(hrand_range);
   }
 
 int hrandstate() {
+  if(active_stream) 
+    return (splitmix64(active_stream->key + active_stream->counter) >> 32) & HRANDMAX;
   std::mt19937 r2 = hrngen;
   return r2() & HRANDMAX;
   }
@@ -182,6 +248,7 @@ void initcell(cell *c) {
   c->pathdist = PINFD;// current distance from the player, along paths (used by yetis)
   c->landparam = 0; c->landflags = 0; c->wparam = 0;
   c->listindex = -1;
+  c->bfs_stamp = 0;
   c->wall  = waNone;
   c->item  = itNone;
   c->monst = moNone;
@@ -662,9 +729,8 @@ bool againstWind(cell *cto, cell *cfrom) {
     if(z >= windmap::NOWINDBELOW && z < windmap::NOWINDFROM)
       return true;
     }
-  whirlwind::calcdirs(cfrom);
   int d = neighborId(cfrom, cto);
-  if(whirlwind::winddir(d) == -1) return true;
+  if(whirlwind::winddir(cfrom, d) == -1) return true;
   return false;
   }
 
@@ -1204,6 +1270,31 @@ eMonster active_switch() {
   }
 
 vector<cell*> crush_now, crush_next;
+
+// threat map: checkmove() probes every possible move with movepcto(..., true),
+// and each probe used to redo the same work. While checkmove() runs, the result
+// of haveRangedTarget() (which does not depend on the move) is kept, and the
+// danger around the cells is memoized: a cell is quiet if nothing is adjacent
+// to it and no Lancer or witch is at distance 2, so no monster can attack it
+// in monstersnear(). With verify, everything is still computed in the old
+// way, and the disagreements are counted; see -benchcheck
+
+namespace threats {
+  bool enabled = true, on, verify;
+  int ranged_target = -1, mismatches;
+  map<cell*, bool> quiet;
+
+  bool isquiet(cell *c) {
+    auto it = quiet.find(c);
+    if(it != quiet.end()) return it->second;
+    bool q = true;
+    forCellEx(c2, c) {
+      if(c2->monst) q = false;
+      forCellEx(c3, c2) if(among(c3->monst, moLancer, moWitchSpeed, moWitchFlash)) q = false;
+      }
+    return quiet[c] = q;
+    }
+  }
   
 bool monstersnear(stalemate1& sm) {
 
@@ -1237,7 +1328,10 @@ bool monstersnear(stalemate1& sm) {
         }
     }
 
-  for(int t=0; t<c->type; t++) {
+  bool quiet = threats::on && threats::isquiet(c);
+  int res0 = res;
+
+  if(!quiet || threats::verify) for(int t=0; t<c->type; t++) {
     cell *c2 = c->move(t);
 
     // consider monsters who attack from distance 2
@@ -1289,6 +1383,8 @@ bool monstersnear(stalemate1& sm) {
       res++, who_kills_me = m;
       }
     }
+  
+  if(quiet && res != res0) threats::mismatches++;
 
   if(sm.who == moPlayer && res && (markOrb2(itOrbShield) || markOrb2(itOrbShell)) && !eaten)
     res = 0;
@@ -2614,6 +2710,15 @@ int tidespeed() {
 
 bool recalcTide;
 
+// the tides, air currents and rose scent are propagated until nothing
+// changes; with worklist_fixpoint, only the cells next to a change are
+// processed again, instead of sweeping dcal (or the whole rosemap)
+bool worklist_fixpoint = true;
+vector<cell*> tide_queue;
+
+// cells processed by these passes, for -benchturns and -fixdiff
+int tide_checks, air_cells, rose_cells;
+
 #define SEADIST LHU.bytes[0]
 #define LANDDIST LHU.bytes[1]
 #define CHAOSPARAM LHU.bytes[2]
@@ -2641,8 +2746,11 @@ void checkTide(cell *c) {
         else if(isSealand(c2->land)) seadist = 1;
         else landdist = 1;
         }
-      if(seadist < csd) csd = seadist, recalcTide = true;
-      if(landdist < cld) cld = landdist, recalcTide = true;
+      if(seadist < csd || landdist < cld) {
+        csd = min<int>(csd, seadist); cld = min<int>(cld, landdist);
+        recalcTide = true;
+        if(worklist_fixpoint) forCellEx(c2, c) if(c2->land == laOcean) tide_queue.push_back(c2);
+        }
       if(seadist == 1 && landdist == 1) t = 15;
       else t = c->CHAOSPARAM = 1 + (29 * (landdist-1)) / (seadist+landdist-2);
       }
@@ -2672,6 +2780,12 @@ void checkTide(cell *c) {
   }
 
 void buildAirmap() {
+  // breadth-first search from the Air Elementals; each cell is listed
+  // once, at its smallest distance
+  manual_celllister cl;
+  vector<pair<cell*, int> > sources;
+  swap(sources, airmap);
+  for(auto& p: sources) if(cl.add(p.first)) airmap.push_back(p);
   for(int k=0; k<isize(airmap); k++) {
     int d = airmap[k].second;
     if(d == 2) break;
@@ -2681,9 +2795,10 @@ void buildAirmap() {
       if(!c2) continue;
       if(!passable(c2, c, P_BLOW | P_MONSTER)) continue;
       if(!passable(c, c2, P_BLOW | P_MONSTER)) continue;
-      airmap.push_back(make_pair(c2, d+1));
+      if(cl.add(c2)) airmap.push_back(make_pair(c2, d+1));
       }
     }
+  air_cells += isize(airmap);
   sort(airmap.begin(), airmap.end());  
   }
 
@@ -2694,9 +2809,26 @@ map<cell*, int> rosemap;
 // 2 - wave phase 1
 // 3 - wave phase 2
 
+// the entries in phase 1..3, the entries added since the last 
+// buildRosemap(), and the entries in the Whirlwind (which can be 
+// blown out at any time); only these can change, apart from the
+// entries next to the Air Elementals
+vector<cell*> rose_live, rose_new, rose_whirl;
+
+int& rosevalue(cell *c) {
+  auto p = rosemap.emplace(c, 0);
+  if(p.second) rose_new.push_back(c);
+  return p.first->second;
+  }
+
+void clearRosemap() {
+  rosemap.clear();
+  rose_live.clear(); rose_new.clear(); rose_whirl.clear();
+  }
+
 int rosedist(cell *c) {
   if(!(havewhat&HF_ROSE)) return 0;
-  int&r (rosemap[c]);
+  int&r (rosevalue(c));
   if((r&7) == 7) return 0;
   if(r&3) return (r&3)-1;
   return 0;
@@ -2714,6 +2846,27 @@ bool withRose(cell *cfrom, cell *cto) {
   return true;
   }
 
+bool roseLive(int r) { 
+  return (r&7) == 1 || (r&7) == 2 || (r&7) == 3;
+  }
+
+void blowRose(cell *c, int& r) {
+  if(airdist(c) < 3 || whirlwind::cat(c)) r |= 7;
+  if(c->land == laBlizzard) r |= 7;
+  forCellEx(c2, c) if(airdist(c2) < 3) r |= 7;
+  }
+
+void expandRose(cell *c, int r) {
+  if((r&7) == 2) if(c->wall == waRose || !isWall(c)) for(int i=0; i<c->type; i++) {
+    cell *c2 = c->move(i);
+    if(!c2) continue;
+    // if(snakelevel(c2) <= snakelevel(c) - 2) continue;
+    if(!passable(c2, c, P_BLOW | P_MONSTER | P_ROSE)) continue;
+    int& r2 = rosevalue(c2);
+    if(r2 < r) r2 = r-1, rose_live.push_back(c2);
+    }
+  }
+
 void buildRosemap() {
 
   rosephase++; rosephase &= 7;
@@ -2723,32 +2876,68 @@ void buildRosemap() {
     for(int k=0; k<isize(dcal); k++) {
       cell *c = dcal[k];
       if(c->wall == waRose && c->cpdist <= gamerange() - 2) 
-        rosemap[c] = rosewave * 8 + 2;
+        rosevalue(c) = rosewave * 8 + 2, rose_live.push_back(c);
       }
     }
   
-  for(map<cell*, int>::iterator it = rosemap.begin(); it != rosemap.end(); it++) {
-    cell *c = it->first;
-    int r = it->second;
-    if(r < (rosewave) * 8) continue;
-    if((r&7) == 2) if(c->wall == waRose || !isWall(c)) for(int i=0; i<c->type; i++) {
-      cell *c2 = c->move(i);
-      if(!c2) continue;
-      // if(snakelevel(c2) <= snakelevel(c) - 2) continue;
-      if(!passable(c2, c, P_BLOW | P_MONSTER | P_ROSE)) continue;
-      int& r2 = rosemap[c2];
-      if(r2 < r) r2 = r-1;
+  if(!worklist_fixpoint) {
+    for(map<cell*, int>::iterator it = rosemap.begin(); it != rosemap.end(); it++) {
+      int r = it->second;
+      if(r < (rosewave) * 8) continue;
+      expandRose(it->first, r);
       }
+
+    for(map<cell*, int>::iterator it = rosemap.begin(); it != rosemap.end(); it++) {
+      int& r = it->second;
+      if(roseLive(r)) r++;
+      blowRose(it->first, r);
+      }
+    rose_cells += 2 * isize(rosemap);
+    rose_live.clear(); rose_new.clear();
+    return;
     }
+  
+  int q = isize(rose_live);
+  for(int k=0; k<q; k++) {
+    cell *c = rose_live[k];
+    int r = rosemap[c];
+    if(r < (rosewave) * 8) continue;
+    expandRose(c, r);
+    }
+  rose_cells += q;
+
+  // a cell is listed again whenever it is reached by the wave
+  sort(rose_live.begin(), rose_live.end());
+  rose_live.erase(unique(rose_live.begin(), rose_live.end()), rose_live.end());
 
-  for(map<cell*, int>::iterator it = rosemap.begin(); it != rosemap.end(); it++) {
-    int& r = it->second;
-    if((r&7) == 1 || (r&7) == 2 || (r&7) == 3) r++;
-    if(airdist(it->first) < 3 || whirlwind::cat(it->first)) r |= 7;
-    if(it->first->land == laBlizzard) r |= 7;
-    forCellEx(c2, it->first) if(airdist(c2) < 3) r |= 7;
+  // the cells blown by the air currents
+  for(auto& p: airmap) {
+    auto it = rosemap.find(p.first);
+    if(it != rosemap.end()) blowRose(it->first, it->second);
+    forCellEx(c2, p.first) {
+      it = rosemap.find(c2);
+      if(it != rosemap.end()) blowRose(it->first, it->second);
+      }
+    rose_cells++;
+    }
+  
+  for(cell *c: rose_new) if(c->land == laWhirlwind) rose_whirl.push_back(c);
+  for(auto v: {&rose_new, &rose_whirl}) for(cell *c: *v) {
+    int& r = rosemap[c];
+    if(!roseLive(r)) blowRose(c, r);
     }
+  rose_cells += isize(rose_new) + isize(rose_whirl);
+  rose_new.clear();
 
+  vector<cell*> live;
+  for(cell *c: rose_live) {
+    int& r = rosemap[c];
+    if(roseLive(r)) r++;
+    blowRose(c, r);
+    if(roseLive(r)) live.push_back(c);
+    }
+  rose_cells += isize(rose_live);
+  swap(live, rose_live);
   }
 
 int getDistLimit() { return base_distlimit; }
@@ -2863,15 +3052,71 @@ void addButterfly(cell *c) {
   butterflies.push_back(make_pair(c, 0));
   }
 
+// incremental bfs(): if every player has moved by at most one cell since
+// the last call, the distances change by at most one, so only the old
+// frontier can leave dcal and the full reset of cpdist can be skipped
+// (visits are marked by a celllister instead). Cells where nothing could
+// happen are not examined in detail. The results are the same as in the
+// full mode; check with -bfsdiff
+
+bool incremental_bfs = false;
+int bfs_repairs = 0;
+
+vector<cell*> bfs_last_players, bfs_old_dcal;
+int bfs_last_limit = -1, bfs_last_size = -1;
+
+bool bfs_can_repair(int distlimit) {
+  if(!incremental_bfs || bfs_owner) return false;
+  if(distlimit != bfs_last_limit || isize(dcal) != bfs_last_size) return false;
+  if(isize(bfs_last_players) != numplayers()) return false;
+  for(int i=0; i<numplayers(); i++) {
+    cell *c = playerpos(i), *c1 = bfs_last_players[i];
+    if(!c || !c1) return false;
+    if(c != c1 && !isNeighbor(c, c1)) return false;
+    }
+  return true;
+  }
+
+// nothing in the big loop of bfs() concerns such a cell
+bool bfs_quiet(cell *c) {
+  if(c->monst || c->item) return false;
+  switch(c->land) {
+    case laOcean: case laVolcano: case laStorms: case laWhirlpool: 
+    case laWhirlwind: case laPrairie: case laHive:
+      return false;
+    default: ;
+    }
+  switch(c->wall) {
+    case waBigStatue: case waVineHalfA: case waVineHalfB: case waCharged:
+    case waRose: case waThumperOn:
+      return false;
+    default: 
+      return true;
+    }
+  }
+
 // calculate cpdist, 'have' flags, and do general fixings
+
 void bfs() {
 
+  profile_start(PROF_BFS);
   calcTidalPhase(); 
     
   yendor::onpath();
   
+  bool repair = bfs_can_repair(gamerange());
+  if(repair) bfs_repairs++;
+  
   int dcs = isize(dcal);
-  for(int i=0; i<dcs; i++) dcal[i]->cpdist = INFD;
+  int old_frontier = dcs;
+  if(repair) {
+    // only the cells at the old limit can leave dcal (which is sorted by cpdist)
+    old_frontier = lower_bound(dcal.begin(), dcal.end(), bfs_last_limit, 
+      [] (cell *c, int d) { return c->cpdist < d; }) - dcal.begin();
+    swap(dcal, bfs_old_dcal);
+    }
+  else for(int i=0; i<dcs; i++) dcal[i]->cpdist = INFD;
+  manual_celllister *cl = repair ? new manual_celllister : NULL;
   worms.clear(); ivies.clear(); ghosts.clear(); golems.clear(); 
   temps.clear(); tempval.clear(); targets.clear(); 
   statuecount = 0;
@@ -2879,6 +3124,7 @@ void bfs() {
 
   hadwhat = havewhat;
   havewhat = 0; jiangshi_on_screen = 0;
+  bool quick = incremental_bfs && !(hadwhat & HF_ROSE);
   snaketypes.clear();
   if(!(hadwhat & HF_WARP)) { avengers = 0; }
   if(!(hadwhat & HF_MIRROR)) { mirrorspirits = 0; }
@@ -2887,16 +3133,16 @@ void bfs() {
   elec::afterOrb = false;
   elec::haveelec = false;
   airmap.clear();
-  if(!(hadwhat & HF_ROSE)) rosemap.clear();
+  if(!(hadwhat & HF_ROSE)) clearRosemap();
   
   dcal.clear(); reachedfrom.clear(); 
 
-  recalcTide = false;
+  recalcTide = false; tide_queue.clear();
   
   for(int i=0; i<numplayers(); i++) {
     cell *c = playerpos(i);
     if(!c) continue;
-    if(c->cpdist == 0) continue;
+    if(repair ? !cl->add(c) : c->cpdist == 0) continue;
     c->cpdist = 0;
     checkTide(c);
     dcal.push_back(c);
@@ -2934,9 +3180,16 @@ void bfs() {
         (c2->wall == waSulphur || c2->wall == waSulphurC))
         c2->wall = waSea;
       
-      if(c2 && signed(c2->cpdist) > d+1) {
+      if(c2 && (repair ? cl->add(c2) : signed(c2->cpdist) > d+1)) {
         c2->cpdist = d+1;
         
+        if(quick && bfs_quiet(c2)) {
+          if(!keepLightning) c2->ligon = 0;
+          dcal.push_back(c2);
+          reachedfrom.push_back(c->c.spin(i));
+          continue;
+          }
+        
         // remove treasures
         if(!peace::on && c2->item && c2->cpdist == distlimit && itemclass(c2->item) == IC_TREASURE &&
           c2->item != itBabyTortoise &&
@@ -3010,7 +3263,7 @@ void bfs() {
 
         if(c2->wall == waRose) havewhat |= HF_ROSE;
         
-        if((hadwhat & HF_ROSE) && (rosemap[c2] & 3)) havewhat |= HF_ROSE;
+        if((hadwhat & HF_ROSE) && (rosevalue(c2) & 3)) havewhat |= HF_ROSE;
         
         if(c2->monst) {
           if(isHaunted(c2->land) && 
@@ -3090,15 +3343,34 @@ void bfs() {
       }
     }
 
-  while(recalcTide) {
+  if(worklist_fixpoint) {
+    for(int k=0; k<isize(tide_queue); k++) {
+      cell *c = tide_queue[k];
+      if(repair ? cl->listed(c) : c->cpdist < INFD) checkTide(c), tide_checks++;
+      }
+    tide_queue.clear(); recalcTide = false;
+    }
+  else while(recalcTide) {
     recalcTide = false;
     for(int i=0; i<isize(dcal); i++) checkTide(dcal[i]);
+    tide_checks += isize(dcal);
     }    
   
   int qtemp = isize(temps);
   for(int i=0; i<qtemp; i++) temps[i]->monst = tempval[i];
   
+  if(repair) {
+    for(int i=old_frontier; i<dcs; i++) 
+      if(!cl->listed(bfs_old_dcal[i])) bfs_old_dcal[i]->cpdist = INFD;
+    delete cl;
+    }
+  bfs_last_limit = distlimit;
+  bfs_last_size = isize(dcal);
+  bfs_last_players.clear();
+  for(int i=0; i<numplayers(); i++) bfs_last_players.push_back(playerpos(i));
+  
   buildAirmap();
+  profile_stop(PROF_BFS);
   }
 
 bool makeEmpty(cell *c) {
@@ -4188,7 +4460,13 @@ void killThePlayerAt(eMonster m, cell *c, flagtype flags) {
   }
 
 void afterplayermoved() {
+  profile_start(PROF_SETDIST);
+  int calls = setdist_calls;
+  auto t0 = std::chrono::steady_clock::now();
   setdist(cwt.at, 7 - getDistLimit() - genrange_bonus, NULL);
+  pregen::after_move(setdist_calls - calls, 
+    std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - t0).count());
+  profile_stop(PROF_SETDIST);
   prairie::treasures();
   if(generatingEquidistant) {
     printf("Warning: generatingEquidistant set to true\n");
@@ -5874,6 +6152,7 @@ void movehex_all() {
   }
   
 void movemonsters() {
+  profile_start(PROF_MONSTERS);
   ambush_distance = 0;
 
   DEBT("lava1");
@@ -5980,6 +6259,7 @@ void movemonsters() {
     if(savepos[i] != playerpos(i)) {
       bfs(); break;
       }
+  profile_stop(PROF_MONSTERS);
   }
 
 // move heat
@@ -6204,8 +6484,13 @@ void checkmove() {
 
   if(multi::players > 1 && !multi::checkonly) return;
   if(hardcore) return;
+  profile_start(PROF_CHECKMOVE);
   bool orbusedbak[ittypes];
   
+  dynamicval<bool> ton(threats::on, threats::enabled || threats::verify);
+  dynamicval<int> trt(threats::ranged_target, -1);
+  threats::quiet.clear();
+
   // do not activate orbs!
   for(int i=0; i<ittypes; i++) orbusedbak[i] = orbused[i];
 
@@ -6252,6 +6537,7 @@ void checkmove() {
 
   for(int i=0; i<ittypes; i++) orbused[i] = orbusedbak[i];
   if(recallCell && !markOrb(itOrbRecall)) activateRecall();  
+  profile_stop(PROF_CHECKMOVE);
   }
 
 // move the PC. Warning: a very long function! todo: refactor
@@ -7409,6 +7695,7 @@ void handle_switchplaces(cell *c1, cell *c2, bool& switchplaces) {
   }  
 
 bool movepcto(int d, int subdir, bool checkonly) {
+  conformal::input_recorder rec('m', d, subdir, checkonly || multi::players > 1);
   if(d >= 0 && !checkonly && subdir != 1 && subdir != -1) printf("subdir = %d\n", subdir);
   global_pushto = NULL;
   bool switchplaces = false;
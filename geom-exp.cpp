@@ -693,11 +693,13 @@ int read_geom_args() {
     }
   else if(argis("-tparx")) {
     shift(); 
+    int mode = torusconfig::torus_mode;
     sscanf(argcs(), "%d,%d,%d", 
-      (int*) &torusconfig::torus_mode,
+      &mode,
       &torusconfig::sdx,
       &torusconfig::sdy
       );
+    torusconfig::torus_mode = torusconfig::eTorusMode(mode);
     if(torusconfig::torus_mode == torusconfig::tmSingle)
       torusconfig::qty = torusconfig::sdx,
       torusconfig::dy = torusconfig::sdy;
@@ -131,7 +131,7 @@ namespace hr { namespace gp {
 
   int spawn;
 
-  cell*& peek(cellwalker cw) {
+  connection_table<cell>::tref peek(cellwalker cw) {
     return cw.at->move(cw.spin);
     }
 
@@ -275,4 +275,116 @@ void hsshow(const heptspin& t) {
 // create h->move(d) if not created yet
 heptagon *createStep(heptagon *h, int d);
 
+// Generate the tree of heptagons (the parent being move(0)) layer by layer.
+// The children of different heptagons of a layer are independent:
+// buildHeptagon writes only the new heptagon, its c7, and one slot of the
+// parent, and reads the parent, the grandparent, and the neighbor S7-1 of
+// the parent. So the links inside a layer are created serially, and then
+// the children are created by several threads, each allocating from its
+// own arena. The result does not depend on the number of threads (see
+// digest). The land generator is not run here.
+
+namespace genlayers {
+  // 0 = std::thread::hardware_concurrency
+  int threads = 0;
+  // time spent in the serial and in the parallel part, in seconds
+  double sertime, partime;
+
+  // only the standard hyperbolic tilings
+  bool available() {
+    return hyperbolic && S3 == 3 && !quotient && !IRREGULAR && !GOLDBERG && !binarytiling && !archimedean && geometry != gCrystal && !hooks_createStep;
+    }
+
+  bool is_child(heptagon *h, int d) {
+    if(h->s == hsOrigin) return true;
+    return d >= 3 && (d < S7-2 || (d == S7-2 && h->s == hsA));
+    }
+
+  void children(const vector<heptagon*>& layer, int from, int to) {
+    for(int i=from; i<to; i++)
+      for(int d=0; d<S7; d++) if(is_child(layer[i], d)) createStep(layer[i], d);
+    }
+
+  // returns the layers 0..n
+  vector<vector<heptagon*>> generate(int n) {
+    vector<vector<heptagon*>> layers(1, {currentmap->getOrigin()});
+    if(!available()) return layers;
+#if CAP_THREADS && !defined(NO_SLAB_ARENA)
+    int k = threads ? threads : std::thread::hardware_concurrency();
+    vector<slab_arena*> arenas;
+    for(int j=1; j<k; j++) arenas.push_back(new slab_arena);
+#endif
+    sertime = partime = 0;
+    for(int l=0; l<n; l++) {
+      auto t0 = std::chrono::steady_clock::now();
+      const vector<heptagon*>& layer = layers[l];
+      for(heptagon *h: layer)
+        for(int d=1; d<S7; d++) if(!is_child(h, d)) createStep(h, d);
+      auto t1 = std::chrono::steady_clock::now();
+      int q = isize(layer);
+#if CAP_THREADS && !defined(NO_SLAB_ARENA)
+      if(k > 1 && q >= 2 * k) {
+        #if CAP_COMPRESSED_MOVES
+        // moves are decompressed via slab_table, so it must not be
+        // reallocated while the threads are running
+        size_t need = slab_table.size() + size_t(q) * S7 * (sizeof(heptagon) + sizeof(cell)) / slab_arena::SLAB_SIZE + 4 * k;
+        if(slab_table.capacity() < need) slab_table.reserve(2 * need);
+        #endif
+        vector<std::thread> th;
+        // the first part is done by this thread, in the map arena
+        for(int j=1; j<k; j++) {
+          slab_arena *a = arenas[j-1];
+          th.emplace_back([&layer, q, j, k, a] {
+            worker_arena = a;
+            children(layer, q * j / k, q * (j+1) / k);
+            worker_arena = NULL;
+            });
+          }
+        children(layer, 0, q / k);
+        for(auto& t: th) t.join();
+        }
+      else
+#endif
+      children(layer, 0, q);
+      vector<heptagon*> next;
+      for(heptagon *h: layer)
+        for(int d=0; d<S7; d++) if(is_child(h, d)) next.push_back(h->move(d));
+      layers.push_back(std::move(next));
+      auto t2 = std::chrono::steady_clock::now();
+      sertime += std::chrono::duration<double>(t1 - t0).count();
+      partime += std::chrono::duration<double>(t2 - t1).count();
+      }
+#if CAP_THREADS && !defined(NO_SLAB_ARENA)
+    for(slab_arena *a: arenas) {
+      get_arena()->absorb(*a);
+      delete a;
+      }
+#endif
+    return layers;
+    }
+
+  // a hash of the generated structure which does not depend on the addresses
+  unsigned digest(const vector<vector<heptagon*>>& layers) {
+    map<heptagon*, int> id;
+    int q = 0;
+    for(auto& l: layers) for(heptagon *h: l) id[h] = q++;
+    unsigned res = 0;
+    auto mix = [&res] (int x) { res = res * 1000003 + x; };
+    int dm0 = layers[0][0]->dm4; // not initialized in the origin
+    for(int l=0; l<isize(layers); l++) for(heptagon *h: layers[l]) {
+      mix(h->s); mix(h->distance); mix((h->dm4 - dm0) & 3);
+      mix(h->emeraldval); mix(h->zebraval); mix(h->fiftyval);
+      if(&currfp != &fieldpattern::fp_invalid) mix(h->fieldval);
+      // the other links of the last layer exist only if something needed them
+      if(l == isize(layers) - 1) continue;
+      for(int d=0; d<S7; d++) {
+        heptagon *h1 = h->move(d);
+        mix(id.count(h1) ? id[h1] : -1);
+        if(h1) mix(h->c.spin(d));
+        }
+      }
+    return res;
+    }
+  }
+
 }
@@ -23,6 +23,7 @@ using std::unordered_map;
 using std::sort;
 using std::multimap;
 using std::set;
+using std::list;
 using std::string;
 using std::function;
 using std::pair;
@@ -273,27 +274,36 @@ namespace hyperpoint_vec {
 
 extern int cellcount, heptacount;
 
+// set in the threads of genlayers: the cells and heptagons are allocated
+// from this arena, and counted only when it is absorbed by the map arena
+#if CAP_THREADS
+extern thread_local struct slab_arena *worker_arena;
+#else
+extern struct slab_arena *worker_arena;
+#endif
+
 // cell information for the game
 
 struct gcell {
 
 #if CAP_BITFIELD
-  // main fields
+  // main fields; together with the distances they fit in the first 8 bytes,
+  // which is all that most passes over dcal need to read
   eLand land : 8;
   eWall wall : 8;
   eMonster monst : 8;
   eItem item : 8;
 
-  // if this is a barrier, what lands on are on the sides?
-  eLand barleft : 8, barright : 8; 
-
-  unsigned ligon : 1;    // is it sparkling with lightning?
-
   signed 
     mpdist : 7,
     pathdist : 8,       // player distance wrt usual movement
     cpdist : 8;         // current/minimum player distance
 
+  unsigned ligon : 1;    // is it sparkling with lightning?
+
+  // if this is a barrier, what lands on are on the sides?
+  eLand barleft : 8, barright : 8; 
+
   unsigned 
     mondir : 4,         // monster direction, for multi-tile monsters and graphics
     bardir : 4,         // barrier direction
@@ -306,9 +316,9 @@ struct gcell {
   eWall wall;
   eMonster monst;
   eItem item;
-  eLand barleft, barright;
-  bool ligon;
   signed char pathdist, cpdist, mpdist;
+  bool ligon;
+  eLand barleft, barright;
   
   unsigned char mondir, bardir, stuntime, hitpoints;
   unsigned char landflags;
@@ -342,7 +352,7 @@ struct gcell {
   int cellid;
   #endif
   
-  gcell() { cellcount++; 
+  gcell() { if(!worker_arena) cellcount++; 
     #ifdef CELLID
     cellid = cellcount;  
     #endif
@@ -361,6 +371,87 @@ struct gcell {
 
 #define MAX_EDGE 14
 
+// Cells and heptagons are allocated from slab arenas. Every slab holds
+// objects of a single size class (i.e., a single degree), and starts with
+// a header which says which arena it belongs to. The map created by
+// initcells owns its arena, so the whole map is released by freeing
+// its slabs, while objects removed individually (e.g. by the memory
+// saver) go to the free list of their size class.
+
+// Compile with NO_SLAB_ARENA to use plain new/delete instead.
+
+struct slab_arena {
+  static const int SLAB_SIZE = 1 << 16;
+  static const int GRANULE = 8;
+  static const int CLASSES = 64;
+
+  struct header {
+    slab_arena *owner;
+    int size;
+    int index; // in slab_table, if CAP_COMPRESSED_MOVES
+    };
+
+  struct size_class {
+    char *next, *end;
+    void *free_list;
+    };
+
+  size_class classes[CLASSES];
+  vector<char*> slabs;
+  // live heptagons [0] and cells [1], to fix heptacount and cellcount on release
+  int live[2];
+  // slabs mapped from a snapshot file (see snapshot.cpp), not in 'slabs'
+  char *mapped;
+  int mapped_slabs;
+
+  slab_arena();
+  ~slab_arena();
+  void *allocate(int size);
+  void init_slab(char *slab, int size);
+  static void release(void *p);
+  static header* header_of(void *p) {
+    return (header*) ((uintptr_t) p & ~uintptr_t(SLAB_SIZE-1));
+    }
+  static slab_arena* owner(void *p) { return header_of(p)->owner; }
+  void absorb(slab_arena& a);
+  };
+
+// all the slabs currently allocated, in all arenas
+extern vector<char*> slab_table;
+
+extern slab_arena *current_arena;
+slab_arena *get_arena();
+void release_map_arena(struct hrmap *m);
+
+#if CAP_COMPRESSED_MOVES
+// Connection tables store 32-bit handles instead of pointers:
+// the index of the slab in slab_table, and the position in that slab.
+// Handle 0 is NULL (there are no objects at position 0, which is the header).
+
+static const int HANDLE_BITS = 13; // log2(SLAB_SIZE / GRANULE)
+
+inline uint32_t ptr_to_handle(void *p) {
+  if(!p) return 0;
+  auto h = slab_arena::header_of(p);
+  return (uint32_t(h->index) << HANDLE_BITS) | uint32_t(((char*)p - (char*)h) / slab_arena::GRANULE);
+  }
+
+inline void *handle_to_ptr(uint32_t h) {
+  if(!h) return NULL;
+  return slab_table[h >> HANDLE_BITS] + (h & ((1<<HANDLE_BITS)-1)) * slab_arena::GRANULE;
+  }
+
+// acts like T*&, for the entries of connection_table
+template<class T> struct move_ref {
+  uint32_t& h;
+  explicit move_ref(uint32_t& h) : h(h) {}
+  operator T*() const { return (T*) handle_to_ptr(h); }
+  T* operator -> () const { return (T*) handle_to_ptr(h); }
+  move_ref& operator = (T* x) { h = ptr_to_handle(x); return *this; }
+  move_ref& operator = (const move_ref& x) { h = x.h; return *this; }
+  };
+#endif
+
 template<class T> struct walker;
 
 template<class T> struct connection_table {
@@ -373,7 +464,13 @@ template<class T> struct connection_table {
 
   unsigned char spintable[6];
   unsigned short mirrortable;
+#if CAP_COMPRESSED_MOVES
+  uint32_t move_table[MAX_EDGE];
+  typedef move_ref<T> tref;
+#else
   T* move_table[MAX_EDGE];
+  typedef T*& tref;
+#endif
   unsigned char spintable_extra[2];
   
   T* full() { T* x = (T*) this; return (T*)((char*)this - ((char*)(&(x->c)) - (char*)x)); }
@@ -392,11 +489,11 @@ template<class T> struct connection_table {
   int spin(int d) { return (get_spinchar(d) >> ((d&1)<<2)) & 15; }
   bool mirror(int d) { return (mirrortable >> d) & 1; }  
   int fix(int d) { return (d + MODFIXER) % full()->degree(); }
-  T*& modmove(int i) { return move(fix(i)); }
-  T*& move(int i) { return move_table[i]; }
+  tref modmove(int i) { return move(fix(i)); }
+  tref move(int i) { return tref(move_table[i]); }
   unsigned char modspin(int i) { return spin(fix(i)); }
   void fullclear() { 
-    for(int i=0; i<MAX_EDGE; i++) move_table[i] = NULL;
+    for(int i=0; i<MAX_EDGE; i++) move(i) = NULL;
     }
   void connect(int d0, T* c1, int d1, bool m) {
     move(d0) = c1;
@@ -409,29 +506,47 @@ template<class T> struct connection_table {
     }
   };
 
-// Allocate a class T with a connection_table, but 
+struct cell;
+
+// Allocate a class T with a connection_table, but
 // with only `degree` connections. Also set yet
 // unknown connections to NULL.
 
 // Generating the hyperbolic world consumes lots of
-// RAM, so we really need to be careful on low memory devices. 
+// RAM, so we really need to be careful on low memory devices.
 
 template<class T> T* tailored_alloc(int degree) {
   const T* sample = (T*) &degree;
   T* result;
+  int b = sizeof(T);
 #ifndef NO_TAILORED_ALLOC
-  if(degree <= 12) {
-    int b = (char*)&sample->c.move_table[degree] - (char*) sample;
-    result = (T*) new char[b];
-    new (result) T();
-    }
-  else 
+  if(degree <= 12)
+    b = (char*)&sample->c.move_table[degree] - (char*) sample;
 #endif
-    result = new T;
-  for(int i=0; i<degree; i++) result->c.move_table[i] = NULL;
+#ifndef NO_SLAB_ARENA
+  slab_arena *a = get_arena();
+  result = (T*) a->allocate(b);
+  a->live[std::is_same<T, cell>::value]++;
+#else
+  result = (T*) new char[b];
+#endif
+  new (result) T();
+  for(int i=0; i<degree; i++) result->c.move(i) = NULL;
   return result;
   }
 
+// destroy an object created with tailored_alloc
+
+template<class T> void tailored_delete(T* x) {
+  x->~T();
+#ifndef NO_SLAB_ARENA
+  slab_arena::owner(x)->live[std::is_same<T, cell>::value]--;
+  slab_arena::release(x);
+#else
+  delete[] (char*) x;
+#endif
+  }
+
 static const struct wstep_t { wstep_t() {} } wstep;
 static const struct wmirror_t { wmirror_t() {}} wmirror;
 static const struct rev_t { rev_t() {} } rev;
@@ -486,7 +601,7 @@ template<class T> struct walker {
   walker<T>& operator -- (int) { return (*this) -= 1; }
   template<class U> walker operator + (U t) const { walker<T> w = *this; w += t; return w; }
   template<class U> walker operator - (U t) const { walker<T> w = *this; w += (-t); return w; }
-  T*& peek() { return at->move(spin); }
+  typename connection_table<T>::tref peek() { return at->move(spin); }
   T* cpeek() { return at->cmove(spin); }
   bool creates() { return !peek(); }
   walker<T> mirrorat(int d) { return walker<T> (at, at->c.fix(d+d - spin), !mirrored); }
@@ -523,10 +638,10 @@ struct heptagon {
   heptagon *alt;
   // connection table
   connection_table<heptagon> c;
-  heptagon*& move(int d) { return c.move(d); }
-  heptagon*& modmove(int d) { return c.modmove(d); }
+  connection_table<heptagon>::tref move(int d) { return c.move(d); }
+  connection_table<heptagon>::tref modmove(int d) { return c.modmove(d); }
   // functions
-  heptagon () { heptacount++; }
+  heptagon () { if(!worker_arena) heptacount++; }
   ~heptagon () { heptacount--; }
   heptagon *cmove(int d) { return createStep(this, d); }
   heptagon *cmodmove(int d) { return createStep(this, c.fix(d)); }
@@ -547,11 +662,14 @@ struct cell : gcell {
 
   int listindex;
 
+  // see manual_celllister
+  uint64_t bfs_stamp;
+
   heptagon *master;
 
   connection_table<cell> c;
-  cell*& move(int d) { return c.move(d); }
-  cell*& modmove(int d) { return c.modmove(d); }
+  connection_table<cell>::tref move(int d) { return c.move(d); }
+  connection_table<cell>::tref modmove(int d) { return c.modmove(d); }
   cell* cmove(int d) { return createMov(this, d); }
   cell* cmodmove(int d) { return createMov(this, c.fix(d)); }
   cell() {}
@@ -700,6 +818,16 @@ void buildCrossroads2(cell *c);
 bool isHaunted(eLand l);
 heptagon *createAlternateMap(cell *c, int rad, hstate firststate, int special=0);
 void setdist(cell *c, int d, cell *from);
+extern int setdist_calls, pregen_time_slice;
+
+namespace pregen {
+  extern int calls, total_ms, critical_calls;
+  extern vector<int> move_us;
+  bool busy();
+  void work(int ms);
+  void after_move(int q, int us);
+  void reset_stats();
+  }
 void checkOnYendorPath();
 void killThePlayerAt(eMonster m, cell *c, flagtype flags);
 bool notDippingFor(eItem i);
@@ -824,6 +952,21 @@ namespace shmup {
   void init();
   void teleported();
   
+  struct monster;
+  
+  // a pointer to a monster which also remembers the generation of its pool
+  // slot; get() returns NULL (and counts a stale access) if the monster has
+  // been deleted since
+  struct monster_ref {
+    monster *m;
+    unsigned gen;
+    monster_ref() : m(NULL), gen(0) {}
+    monster_ref(monster *_m);
+    monster *get() const;
+    operator monster* () const { return get(); }
+    monster* operator -> () const { return get(); }
+    };
+  
   struct monster {
     eMonster type;
     cell *base;
@@ -837,7 +980,7 @@ namespace shmup {
     bool notpushed;
     bool inBoat;
     bool no_targetting;
-    monster *parent; // who shot this missile
+    monster_ref parent; // who shot this missile
     eMonster parenttype; // type of the parent
     int nextshot;    // when will it be able to shot (players/flailers)
     int pid;         // player ID
@@ -848,12 +991,20 @@ namespace shmup {
     double vel;        // velocity, for flail balls
     double footphase;
     bool isVirtual;  // off the screen: gmatrix is unknown, and pat equals at
+    int collid;      // index in nonvirtual, for the collision buckets
+    monster *nextAt; // the next monster stored in the same cell
+    transmatrix prevrel; // the pose before the last fixed step, relative to the current one
+    int prevstep;    // the fixed step in which prevrel has been computed
     
     monster() { 
       dead = false; inBoat = false; parent = NULL; nextshot = 0; 
       stunoff = 0; blowoff = 0; footphase = 0; no_targetting = false;
-      swordangle = 0;
+      swordangle = 0; collid = -1; prevstep = -1;
       }
+    
+    // allocated from the pool in shmup.cpp
+    static void *operator new(size_t size);
+    static void operator delete(void *p);
   
     void store();
       
@@ -865,7 +1016,7 @@ namespace shmup {
   
     };
 
-  extern struct monster* mousetarget;
+  extern monster_ref mousetarget;
   extern monster *pc[MAXPLAYER];
   extern eItem targetRangedOrb(orbAction a);
   void degradeDemons();
@@ -896,7 +1047,10 @@ namespace shmup {
   extern hookset<bool(shmup::monster*, string&)> *hooks_describe;
 
   void turn(int);
-  extern monster *lmousetarget;
+  // advance the simulation by the frame time (in fixed steps if set)
+  void advance(int);
+  namespace fixedstep { extern int length, maxsteps; }
+  extern monster_ref lmousetarget;
   void virtualRebase(shmup::monster *m, bool tohex);
 
   extern monster *pc[MAXPLAYER];
@@ -1320,6 +1474,16 @@ namespace conformal {
   extern vector<pair<cell*, eItem> > findhistory;  
   extern vector<cell*> movehistory;
   extern set<cell*> inmovehistory, inkillhistory, infindhistory;
+
+  // records an input when it goes out of scope, see conformal.cpp
+  struct input_recorder {
+    char type; int a, b, spin; bool mirrored, active;
+    input_recorder(char t, int x, int y, bool checkonly);
+    ~input_recorder();
+    };
+  int dcal_index(cell *c);
+  void restart_with_seed(int seed);
+  extern FILE *inputlog;
   extern bool includeHistory;
   extern ld rotation;
   extern int do_rotate;
@@ -1553,6 +1717,8 @@ cell *playerpos(int i);
 
 bool makeflame(cell *c, int timeout, bool checkonly);
 void bfs();
+extern bool incremental_bfs;
+extern int bfs_repairs;
 bool isPlayerInBoatOn(cell *c);
 bool isPlayerInBoatOn(cell *c, int i);
 void destroyBoats(cell *c, cell *cf, bool strandedToo);
@@ -1695,6 +1861,12 @@ namespace stalemate {
   bool isPushto(cell *c);
   };
 
+namespace threats {
+  extern bool enabled, on, verify;
+  extern int ranged_target, mismatches;
+  bool isquiet(cell *c);
+  };
+
 extern int turncount;
 
 bool reduceOrbPower(eItem it, int cap);
@@ -2332,7 +2504,24 @@ bool doexiton(int sym, int uni);
 void switchFullscreen();
 string turnstring(int i);
 int celldistance(cell *c1, cell *c2);
+
+// cached distances from a source cell: in bounded geometries to all the cells,
+// otherwise to the cells found by a celllister around the source
+struct distance_table {
+  cell *source;
+  bool dense;
+  vector<unsigned char> dist; // if dense, indexed by cell_index
+  vector<pair<cell*, unsigned char>> near; // if not dense, sorted by cell
+  int get(cell *c) const; // -1 if not known
+  size_t bytes() const { return dist.capacity() + near.capacity() * sizeof(near[0]) + sizeof(*this); }
+  };
+
+// the table is valid until the next call
+const distance_table& distances_from(cell *c);
+vector<int> distances_between(const vector<pair<cell*, cell*>>& pairs);
+extern int distance_cache_mb;
 int hyperbolic_celldistance(cell *c1, cell *c2);
+vector<cell*> build_shortest_path(cell *c1, cell *c2);
 bool behindsphere(const transmatrix& V);
 extern hyperpoint pirateCoords;
 
@@ -2918,9 +3107,14 @@ bool isWarped(eLand l);
 bool isWarped(cell *c);
 
 struct hrmap {
+  // the arena owned by this map (see initcells), or NULL
+  slab_arena *arena;
+  hrmap() : arena(NULL) {}
+  // if true, the cells and heptagons will be released together with the arena
+  bool bulk_release() { return arena && !IRREGULAR; }
   virtual heptagon *getOrigin() { return NULL; }
   virtual cell *gamestart() { return getOrigin()->c7; }
-  virtual ~hrmap() { };
+  virtual ~hrmap() { release_map_arena(this); }
   virtual vector<cell*>& allcells() { return dcal; }
   virtual void verify() { }
   };
@@ -2929,12 +3123,13 @@ struct hrmap_hyperbolic : hrmap {
   heptagon *origin;
   eVariation mvar;
   hrmap_hyperbolic();
+  hrmap_hyperbolic(heptagon *o) : origin(o), mvar(variation) {}
   heptagon *getOrigin() { return origin; }
   ~hrmap_hyperbolic() {
     DEBMEM ( verifycells(origin); )
     // printf("Deleting hyperbolic map: %p\n", this);
     dynamicval<eVariation> ph(variation, mvar);
-    clearfrom(origin);
+    if(!bulk_release()) clearfrom(origin);
     }
   void verify() { verifycells(origin); }
   };
@@ -2965,29 +3160,76 @@ namespace irr {
 extern hrmap *currentmap;
 extern vector<hrmap*> allmaps;
 
-// list all cells in distance at most maxdist, or until when maxcount cells are reached
+// vectors are taken from a pool and given back when done, so that
+// the listers do not allocate memory once warmed up
+
+template<class T> struct buffer_pool {
+  vector<vector<T>> pool;
+  void take(vector<T>& v) { 
+    if(!pool.empty()) { v.swap(pool.back()); pool.pop_back(); }
+    }
+  void give(vector<T>& v) {
+    // do not keep the huge ones
+    if(v.capacity() > (1<<20)) { vector<T>().swap(v); return; }
+    v.clear(); pool.emplace_back(); pool.back().swap(v);
+    }
+  };
+
+extern buffer_pool<cell*> celllist_pool;
+extern buffer_pool<int> celldist_pool;
+
+// the visits are marked in cell::bfs_stamp: generation in the upper half,
+// index in lst in the lower half; so nothing needs to be restored afterwards.
+// Only one lister at a time owns the stamps -- a lister created while
+// another one exists keeps its indices in a map instead
+
+struct manual_celllister;
+extern manual_celllister *bfs_owner;
+extern unsigned bfs_generation;
 
 struct manual_celllister {
   vector<cell*> lst;
-  vector<int> tmps;
+  unsigned generation; // 0 if nested
+  map<cell*, int> nested;
+  
+  manual_celllister() {
+    celllist_pool.take(lst);
+    if(bfs_owner) generation = 0;
+    else {
+      bfs_owner = this;
+      generation = ++bfs_generation;
+      if(!generation) generation = ++bfs_generation;
+      }
+    }
+  
+  manual_celllister(const manual_celllister&) = delete;
+  manual_celllister& operator=(const manual_celllister&) = delete;
 
-  bool listed(cell *c) {
-    return c->listindex >= 0 && c->listindex < isize(lst) && lst[c->listindex] == c;
+  int index(cell *c) {
+    if(generation) 
+      return (c->bfs_stamp >> 32) == generation ? int(c->bfs_stamp & 0xFFFFFFFF) : -1;
+    auto it = nested.find(c);
+    return it == nested.end() ? -1 : it->second;
     }
+
+  bool listed(cell *c) { return index(c) >= 0; }
   
   bool add(cell *c) {
     if(listed(c)) return false;
-    tmps.push_back(c->listindex);
-    c->listindex = isize(lst);
+    if(generation) c->bfs_stamp = (uint64_t(generation) << 32) | unsigned(isize(lst));
+    else nested[c] = isize(lst);
     lst.push_back(c);
     return true;
     }
 
-  ~manual_celllister() {     
-    for(int i=0; i<isize(lst); i++) lst[i]->listindex = tmps[i];
+  ~manual_celllister() {
+    if(bfs_owner == this) bfs_owner = NULL;
+    celllist_pool.give(lst);
     }  
   };
-  
+
+// list all cells in distance at most maxdist, or until when maxcount cells are reached;
+// stop immediately when breakon is found
 
 struct celllister : manual_celllister {
   vector<int> dists;
@@ -2997,8 +3239,21 @@ struct celllister : manual_celllister {
     }
   
   celllister(cell *orig, int maxdist, int maxcount, cell *breakon) {
+    celldist_pool.take(dists);
     add_at(orig, 0);
-    cell *last = orig;
+    expand(maxdist, maxcount, breakon);
+    }
+
+  // multiple sources, all at distance 0
+  celllister(const vector<cell*>& orig, int maxdist, int maxcount, cell *breakon) {
+    celldist_pool.take(dists);
+    for(cell *c: orig) add_at(c, 0);
+    expand(maxdist, maxcount, breakon);
+    }
+  
+  void expand(int maxdist, int maxcount, cell *breakon) {
+    if(lst.empty()) return;
+    cell *last = lst.back();
     for(int i=0; i<isize(lst); i++) {
       cell *c = lst[i];
       if(maxdist) forCellCM(c2, c) {
@@ -3012,7 +3267,9 @@ struct celllister : manual_celllister {
       }
     }
 
-  int getdist(cell *c) { return dists[c->listindex]; }
+  int getdist(cell *c) { return dists[index(c)]; }
+
+  ~celllister() { celldist_pool.give(dists); }
   };
 
 hrmap *newAltMap(heptagon *o);
@@ -3383,6 +3640,11 @@ extern vector<msginfo> gamelog;
 extern time_t savetime;
 extern bool cblind;
 extern void save_memory();
+extern int memory_budget, memory_time_slice;
+extern int reclaimed_cells, reclaim_time, reclaim_slices;
+bool memory_saver_busy();
+void continue_memory_saving();
+int cells_memory_mb();
 namespace inv { void init(); }
 extern bool survivalist;
 extern bool hauntedWarning;
@@ -3391,6 +3653,10 @@ extern bool usedSafety;
 namespace elec { extern int lightningfast; }
 extern int lastkills;
 extern map<cell*, int> rosemap;
+int& rosevalue(cell *c);
+void clearRosemap();
+extern bool worklist_fixpoint;
+extern int tide_checks, air_cells, rose_cells;
 extern int hardcoreAt;
 extern flagtype havewhat, hadwhat;
 extern int safetyseed;
@@ -3421,6 +3687,7 @@ hyperpoint xspinpush0(ld alpha, ld x);
 #define DF_GRAPH             2
 #define DF_TURN              4
 #define DF_FIELD             8
+#define DF_MEMORY           16
 
 #if ISANDROID
 #define DEBB(r,x)
@@ -4058,6 +4325,25 @@ extern hpcshape shDisk, shTriangle, shHeptaMarker, shSnowball, shDiskT, shDiskS,
 
 extern std::mt19937 hrngen;
 
+extern bool position_rng;
+extern unsigned long long world_seed;
+bool position_rng_supported();
+unsigned long long position_code(cell *c);
+
+struct keyed_stream {
+  unsigned long long key;
+  unsigned long long counter;
+  };
+
+// while this exists, hrand and friends are keyed by the position of c and 
+// 'purpose' (if position_rng is on)
+struct position_rng_guard {
+  keyed_stream *saved;
+  keyed_stream stream;
+  position_rng_guard(cell *c, int purpose);
+  ~position_rng_guard();
+  };
+
 bool anglestraight(cell *c, int d1, int d2);
 
 hyperpoint randomPointIn(int t);
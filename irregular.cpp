@@ -564,7 +564,7 @@ void clear_links(heptagon *h) {
   for(cell *c: hi.subcells) {
     for(int i=0; i<c->type; i++) if(c->move(i)) c->move(i)->move(c->c.spin(i)) = NULL;
     cellindex.erase(c);
-    delete c;
+    tailored_delete(c);
     }
   h->c7 = NULL;
   periodmap.erase(h);
@@ -578,7 +578,7 @@ void link_next(heptagon *parent, int d) {
   if(!periodmap.count(parent))
     link_to_base(parent, heptspin(cells[0].owner->master, 0));
   // printf("linking next: %p direction %d [s%d]\n", parent, d, parent->c.spin(d));
-  auto *h = parent->move(d);
+  heptagon *h = parent->move(d);
   heptspin hs = periodmap[parent].base + d + wstep - parent->c.spin(d);
   link_to_base(h, hs);
   }
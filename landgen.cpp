@@ -2366,12 +2366,16 @@ void repairLandgen(cell *c) {
     }
   }
 
+int setdist_calls;
+
 void setdist(cell *c, int d, cell *from) {
   
   if(c->mpdist <= d) return;
   if(c->mpdist > d+1 && d != BARLEV) setdist(c, d+1, from);
   c->mpdist = d;
+  setdist_calls++;
   // printf("setdist %p %d [%p]\n", c, d, from);
+  position_rng_guard prg(c, d);
   
   // this fixes the following problem:
   // http://steamcommunity.com/app/342610/discussions/0/1470840994970724215/
@@ -2499,4 +2503,96 @@ void setdist(cell *c, int d, cell *from) {
 #endif
   }
 
+// speculative generation: while the player is idle, the cells which the
+// next move would bring to BARLEV (lands, barriers and big structures) are
+// generated in advance, in slices of at most pregen_time_slice ms of the 
+// idle time of the main loop; the cell in front of the player goes first,
+// then the other neighbors. The lower stages (monsters and items) are still
+// generated by the move itself. World generation is not thread-safe (the
+// RNG, the cell graph and the big structures are shared), so this runs in
+// the main thread rather than in a worker. It also consumes hrngen by an
+// amount which depends on the idle time, so it is off while recording with
+// -record, unless -posrng keys the generation by position instead
+
+int pregen_time_slice = 0;
+
+namespace pregen {
+  struct entry { cell *c, *from; int d; };
+  
+  cell *center;
+  vector<cell*> targets;
+  int next_target;
+  vector<entry> queue;
+  int next_entry;
+  set<cell*> seen;
+
+  // statistics: setdist calls and time in ms in work(), and setdist calls
+  // and time in us of every afterplayermoved()
+  int calls, total_ms;
+  int critical_calls;
+  vector<int> move_us;
+  
+  void reset() {
+    center = NULL; targets.clear(); queue.clear(); seen.clear();
+    next_target = next_entry = 0;
+    }
+  
+  // the distance afterplayermoved() sets for the player's cell
+  int startdist() { return 7 - getDistLimit() - genrange_bonus; }
+
+  void restart() {
+    reset();
+    center = cwt.at;
+    // after a move, cwt.spin points back, so start from the opposite side
+    int t = cwt.at->type;
+    for(int i=0; i<t; i++) {
+      int j = cwt.spin + t/2 + ((i&1) ? -(i+1)/2 : i/2);
+      targets.push_back(createMov(cwt.at, gmod(j, t)));
+      }
+    }
+  
+  bool busy() { return center != cwt.at || next_target < isize(targets) || next_entry < isize(queue); }
+  
+  void add(cell *c, cell *from, int d) {
+    if(seen.count(c)) return;
+    seen.insert(c);
+    queue.push_back(entry{c, from, d});
+    }
+
+  void work(int ms) {
+    if(center != cwt.at) restart();
+    int t0 = SDL_GetTicks();
+    int cc = setdist_calls;
+    while(!buggyGeneration) {
+      if(next_entry == isize(queue)) {
+        if(next_target == isize(targets)) break;
+        queue.clear(); seen.clear(); next_entry = 0;
+        add(targets[next_target++], cwt.at, startdist());
+        continue;
+        }
+      entry e = queue[next_entry++];
+      // the cells within BARLEV-d from here were generated with this cell
+      if(e.c->mpdist <= e.d) continue;
+      setdist(e.c, BARLEV, e.from);
+      if(e.d < BARLEV) for(int i=0; i<e.c->type; i++)
+        add(createMov(e.c, i), e.c, e.d+1);
+      if(int(SDL_GetTicks()) - t0 >= ms) break;
+      }
+    calls += setdist_calls - cc;
+    total_ms += SDL_GetTicks() - t0;
+    }
+  
+  void after_move(int q, int us) {
+    critical_calls += q;
+    move_us.push_back(us);
+    }
+
+  void reset_stats() {
+    calls = total_ms = critical_calls = 0;
+    move_us.clear();
+    }
+
+  auto hooks = addHook(clearmemory, 0, reset) + addHook(hooks_removecells, 0, reset);
+  }
+
 }
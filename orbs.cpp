@@ -498,13 +498,20 @@ void activateLightning() {
 bool haveRangedTarget() {
   if(!haveRangedOrb())
     return false;
+  using namespace threats;
+  if(on && ranged_target >= 0 && !verify) return ranged_target;
+  bool b = false;
   for(int i=0; i<isize(dcal); i++) {
     cell *c = dcal[i];
     if(targetRangedOrb(c, roCheck)) {
-      return true;
+      b = true; break;
       }
     }
-  return false;
+  if(on) {
+    if(ranged_target >= 0 && ranged_target != b) mismatches++;
+    ranged_target = b;
+    }
+  return b;
   }
 
 void checkmoveO() {
@@ -969,13 +976,17 @@ bool isWeakCheck(orbAction a) { return a == roCheck || a == roMultiCheck || a ==
 
 eItem targetRangedOrb(cell *c, orbAction a) {
 
+  // dcal_index scans dcal, so it is only computed when the input is logged
+  bool checkonly = isCheck(a) || a == roMultiGo;
+  conformal::input_recorder rec('o', checkonly ? -1 : conformal::dcal_index(c), a, checkonly);
+
   if(!haveRangedOrb()) {
     return itNone;
     }
   
   if(rosedist(cwt.at) == 1) {
-    int r = rosemap[cwt.at];
-    int r2 = rosemap[c];
+    int r = rosevalue(cwt.at);
+    int r2 = rosevalue(c);
     if(r2 <= r) {
       if(a == roKeyboard || a == roMouseForce ) 
         addMessage(XLAT("Those roses smell too nicely. You can only target cells closer to them!"));
@@ -5,10 +5,23 @@ namespace hr {
 
 bool memory_saving_mode = true;
 
+// if positive, faraway cells are forgotten only when cells and heptagons
+// take more than this many MB
+int memory_budget = 0;
+
+// time (in ms) spent on forgetting cells per turn or frame; 0 = no limit
+int memory_time_slice = 10;
+
 static const int LIM = 150;
 
 heptagon *last_cleared;
 
+// statistics of the last completed pass
+int reclaimed_cells, reclaim_time, reclaim_slices;
+
+// statistics of the current pass
+int pass_cells, pass_time, pass_slices;
+
 void destroycellcontents(cell *c) {
   c->land = laMemory;
   c->wall = waChasm;
@@ -17,12 +30,24 @@ void destroycellcontents(cell *c) {
     c->monst = moNone;
   }
 
+// cells to degrade, together with the mpdist of the cell which requested it
+vector<pair<cell*, int>> degrade_stack;
+
+// increase mpdist of c, and then of its neighbors, as long as they
+// differ by more than 1
 void degrade(cell *c) {
-  c->mpdist++;
-  forCellEx(c2, c)
-    if(c2->mpdist < c->mpdist - 1)
-      degrade(c2);
-  destroycellcontents(c);
+  degrade_stack.emplace_back(c, c->mpdist + 2);
+  while(!degrade_stack.empty()) {
+    cell *c1 = degrade_stack.back().first;
+    int from = degrade_stack.back().second;
+    degrade_stack.pop_back();
+    if(c1->mpdist >= from - 1) continue;
+    c1->mpdist++;
+    forCellEx(c2, c1)
+      if(c2->mpdist < c1->mpdist - 1)
+        degrade_stack.emplace_back(c2, int(c1->mpdist));
+    destroycellcontents(c1);
+    }
   }
 
 vector<cell*> removed_cells;
@@ -35,7 +60,7 @@ void slow_delete_cell(cell *c) {
     if(c->move(i))
       c->move(i)->move(c->c.spin(i)) = NULL;
   removed_cells.push_back(c);
-  delete c;
+  tailored_delete(c);
   }
 
 void delete_heptagon(heptagon *h2) {
@@ -49,14 +74,10 @@ void delete_heptagon(heptagon *h2) {
   for(int i=0; i<S7; i++)
     if(h2->move(i))
       h2->move(i)->move(h2->c.spin(i)) = NULL;
-  delete h2;
+  tailored_delete(h2);
   }
 
-void recursive_delete(heptagon *h, int i) {
-  heptagon *h2 = h->move(i);
-  { for(int i=1; i<S7; i++)
-    if(h2->move(i) && h2->move(i)->move(0) == h2)
-      recursive_delete(h2, i); }
+void delete_with_alt(heptagon *h2) {
   if(h2->alt && h2->alt->alt == h2->alt) {
     DEBSM(printf("destroying alternate map %p\n", h2->alt);)
     for(hrmap *& hm: allmaps) {
@@ -74,7 +95,74 @@ void recursive_delete(heptagon *h, int i) {
     h2->alt->cdata = NULL;
     }
   delete_heptagon(h2);
-  h->move(i) = NULL;  
+  }
+
+// The subtrees to delete are traversed in post-order, using an explicit stack,
+// so that the work can be interrupted and continued in the next turn or frame.
+
+struct deletion_frame {
+  heptagon *h;
+  int dir; // next child to check
+  };
+
+vector<deletion_frame> deletion_stack;
+
+// roots of the subtrees, given as (parent, direction) -- the parent is kept;
+// the root is looked up only when we get to it, since it might be already 
+// gone as a part of an earlier subtree
+vector<pair<heptagon*, int>> deletion_roots;
+int next_root;
+
+void recursive_delete(heptagon *h, int i) {
+  deletion_roots.emplace_back(h, i);
+  }
+
+bool memory_saver_busy() { return next_root < isize(deletion_roots) || !deletion_stack.empty(); }
+
+void continue_memory_saving() {
+  if(!memory_saver_busy()) return;
+  int t0 = SDL_GetTicks();
+  int cc = cellcount;
+  while(true) {
+    if(deletion_stack.empty()) {
+      if(next_root == isize(deletion_roots)) break;
+      auto& r = deletion_roots[next_root++];
+      if(r.first->move(r.second))
+        deletion_stack.push_back(deletion_frame{r.first->move(r.second), 1});
+      continue;
+      }
+    auto& f = deletion_stack.back();
+    heptagon *h2 = f.h;
+    if(f.dir < S7) {
+      heptagon *h3 = h2->move(f.dir++);
+      if(h3 && h3->move(0) == h2)
+        deletion_stack.push_back(deletion_frame{h3, 1});
+      continue;
+      }
+    deletion_stack.pop_back();
+    delete_with_alt(h2);
+    if(memory_time_slice && int(SDL_GetTicks()) - t0 >= memory_time_slice) break;
+    }
+  
+  pass_cells += cc - cellcount;
+  pass_time += SDL_GetTicks() - t0;
+  pass_slices++;
+  
+  sort(removed_cells.begin(), removed_cells.end());
+  callhooks(hooks_removecells);
+  removed_cells.clear();
+
+  if(!memory_saver_busy()) {
+    deletion_roots.clear(); next_root = 0;
+    reclaimed_cells = pass_cells; reclaim_time = pass_time; reclaim_slices = pass_slices;
+    DEBB(DF_MEMORY, (debugfile, "memory saver: %d cells reclaimed in %d ms (%d slices), current cellcount = %d\n", 
+      reclaimed_cells, reclaim_time, reclaim_slices, cellcount));
+    }
+  }
+
+// approximate memory taken by cells and heptagons, in MB
+int cells_memory_mb() {
+  return int((cellcount * (long long) sizeof(cell) + heptacount * (long long) sizeof(heptagon)) >> 20);
   }
 
 bool unsafeLand(cell *c) {
@@ -86,6 +174,8 @@ bool unsafeLand(cell *c) {
 void save_memory() {
   if(quotient || !hyperbolic || NONSTDVAR) return;
   if(!memory_saving_mode) return;
+  if(memory_saver_busy()) { continue_memory_saving(); return; }
+  if(memory_budget > 0 && cells_memory_mb() < memory_budget) return;
   if(unsafeLand(cwt.at)) return;
   int d = celldist(cwt.at);
   if(d < LIM+10) return;
@@ -156,11 +246,16 @@ void save_memory() {
   last_cleared = at1;
   DEBSM(printf("current cellcount = %d\n", cellcount);)
   
-  sort(removed_cells.begin(), removed_cells.end());
-  callhooks(hooks_removecells);
-  removed_cells.clear();
+  pass_cells = pass_time = pass_slices = 0;
+  continue_memory_saving();
   }
 
+auto savemem_hooks = addHook(clearmemory, 0, [] () {
+  deletion_stack.clear();
+  deletion_roots.clear(); next_root = 0;
+  removed_cells.clear();
+  });
+
 purehookset hooks_removecells;
 
 bool is_cell_removed(cell *c) {
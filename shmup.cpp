@@ -992,12 +992,255 @@ bool lastdead = false;
 
 struct monster;
 
-multimap<cell*, monster*> monstersAt;
+// all the monsters (including bullets and fireballs) are allocated from
+// this pool; the freed slots are reused in LIFO order, and each slot has
+// a generation which changes whenever it is freed, so that the monster_refs
+// to the monsters deleted in the meantime are detected
+namespace pool {
+  struct slot {
+    unsigned generation;
+    slot *nextfree;
+    alignas(monster) unsigned char data[sizeof(monster)];
+    };
+  
+  static const int chunksize = 1024;
+  vector<slot*> chunks;
+  slot *freelist;
+  
+  int allocs, frees, live, peak, reused, stale;
+  
+  slot *slotof(monster *m) {
+    return reinterpret_cast<slot*> (reinterpret_cast<unsigned char*>(m) - offsetof(slot, data));
+    }
+  
+  void *alloc() {
+    if(!freelist) {
+      slot *s = new slot[chunksize];
+      chunks.push_back(s);
+      for(int i=chunksize-1; i>=0; i--)
+        s[i].generation = 0, s[i].nextfree = freelist, freelist = s+i;
+      }
+    else if(freelist->generation) reused++;
+    slot *s = freelist;
+    freelist = s->nextfree;
+    s->nextfree = NULL;
+    allocs++; live++;
+    if(live > peak) peak = live;
+    return s->data;
+    }
+  
+  void free(void *p) {
+    if(!p) return;
+    slot *s = slotof((monster*) p);
+    s->generation++;
+    s->nextfree = freelist;
+    freelist = s;
+    frees++; live--;
+    }
+  
+  void resetCounters() {
+    allocs = frees = reused = stale = 0; peak = live;
+    }
+  }
+
+void *monster::operator new(size_t) { return pool::alloc(); }
+void monster::operator delete(void *p) { pool::free(p); }
+
+monster_ref::monster_ref(monster *_m) : m(_m), gen(_m ? pool::slotof(_m)->generation : 0) {}
+
+monster *monster_ref::get() const {
+  if(m && pool::slotof(m)->generation != gen) {
+    pool::stale++;
+    return NULL;
+    }
+  return m;
+  }
 
-typedef multimap<cell*, monster*>::iterator mit;
+// the monsters which are not active, by their base cells: the monsters 
+// stored at a cell form a list (via nextAt, in the order of storing), 
+// and the cells are found in an open addressing table, which is never
+// shrunk (except when rehashing), so there are no allocations per monster
+namespace monstersAt {
+  struct bucket { cell *c; monster *first, *last; };
+  vector<bucket> table;
+  // the cells in the table
+  int used;
+  // the monsters from the removed cells
+  bucket removed;
+  
+  bucket *find(cell *c) {
+    if(table.empty()) return NULL;
+    int mask = isize(table) - 1;
+    int i = (size_t(c) >> 4) * 2654435761u & mask;
+    while(table[i].c && table[i].c != c) i = (i+1) & mask;
+    return &table[i];
+    }
+
+  void rehash(int size) {
+    vector<bucket> old(size, bucket{NULL, NULL, NULL});
+    swap(old, table); used = 0;
+    for(auto& b: old) if(b.first) *find(b.c) = b, used++;
+    }
+
+  bucket& at(cell *c) {
+    if(!c) return removed;
+    if(2 * (used+1) > isize(table)) {
+      // the empty buckets are dropped
+      int q = 1, size = 64;
+      for(auto& b: table) if(b.first) q++;
+      while(size < 4 * q) size <<= 1;
+      rehash(size);
+      }
+    bucket *b = find(c);
+    if(!b->c) b->c = c, b->first = b->last = NULL, used++;
+    return *b;
+    }
+  
+  void insert(monster *m);
+
+  // the first monster at c (follow nextAt for the others)
+  monster *first(cell *c) {
+    bucket *b = find(c);
+    return b && b->c ? b->first : NULL;
+    }
+
+  // remove all the monsters at c from the storage, and return the first one
+  monster *take(cell *c) {
+    bucket *b = find(c);
+    if(!b || !b->c || !b->first) return NULL;
+    monster *m = b->first;
+    b->first = b->last = NULL;
+    return m;
+    }
+  
+  template<class T> void forEach(const T& f);
+  
+  void clear() {
+    table.clear(); used = 0;
+    removed.first = removed.last = NULL;
+    }
+  }
 
 vector<monster*> active, nonvirtual, additional;
 
+// the nonvirtual monsters, bucketed by their base cells, so that the
+// collisions are checked only against the monsters within 'ring' cells;
+// the buckets are built in turn(), and a monster is moved to another
+// bucket whenever its base changes (see update())
+namespace collision {
+  bool on = true;
+  // also compare every query with the full scan of nonvirtual
+  bool verify;
+  int ring = 2;
+  int queries, candidates, mismatches;
+  
+  // open addressing table: cell -> the first monster in its bucket
+  vector<cell*> keys;
+  vector<int> heads;
+  // the last query which has scanned the bucket
+  vector<int> seen;
+  int used;
+  // for each monster (index in nonvirtual): its cell and the bucket list
+  vector<cell*> filed;
+  vector<int> nxt, prv, slot;
+  
+  // how many nonvirtual monsters have the given parent
+  map<monster*, int> children;
+  
+  int find(cell *c) {
+    int mask = isize(keys) - 1;
+    int i = (size_t(c) >> 4) * 2654435761u & mask;
+    while(keys[i] && keys[i] != c) i = (i+1) & mask;
+    return i;
+    }
+  
+  void file(int id, cell *c) {
+    int i = find(c);
+    if(!keys[i]) keys[i] = c, heads[i] = -1, used++;
+    filed[id] = c; slot[id] = i;
+    prv[id] = -1; nxt[id] = heads[i];
+    if(nxt[id] >= 0) prv[nxt[id]] = id;
+    heads[i] = id;
+    }
+  
+  void unfile(int id) {
+    if(prv[id] >= 0) nxt[prv[id]] = nxt[id];
+    else heads[slot[id]] = nxt[id];
+    if(nxt[id] >= 0) prv[nxt[id]] = prv[id];
+    }
+  
+  void rehash(int size) {
+    keys.assign(size, NULL); heads.assign(size, -1); seen.assign(size, -1); used = 0;
+    for(int id=0; id<isize(filed); id++) file(id, filed[id]);
+    }
+
+  void build() {
+    int n = isize(nonvirtual);
+    filed.resize(n); nxt.resize(n); prv.resize(n); slot.resize(n);
+    children.clear();
+    for(monster *m: active) m->collid = -1;
+    for(int id=0; id<n; id++) {
+      monster *m = nonvirtual[id];
+      m->collid = id; filed[id] = m->base;
+      children[m->parent]++;
+      }
+    int size = 64;
+    while(size < 4 * n) size <<= 1;
+    rehash(size);
+    }
+  
+  bool indexed(monster *m) {
+    return on && m->collid >= 0 && m->collid < isize(nonvirtual) && nonvirtual[m->collid] == m;
+    }
+
+  void update(monster *m) {
+    if(!indexed(m)) return;
+    int id = m->collid;
+    if(filed[id] == m->base) return;
+    unfile(id);
+    if(2 * used >= isize(keys)) filed[id] = m->base, rehash(2 * isize(keys));
+    else file(id, m->base);
+    }
+
+  // is there any monster which is not excluded by the 'same parent' rule 
+  // in moveBullet? (there, markOrb should be called only in this case)
+  bool has_targets(monster *m) {
+    int q = isize(nonvirtual) - children[m->parent];
+    if(m->parent && m->vel >= 0 && indexed(m->parent) && m->parent->parent != m->parent) q--;
+    return q > 0;
+    }
+
+  // the nonvirtual monsters which could be closer than sqrt(maxval) to h 
+  // (which is in the cell c, or close to it), in the order of nonvirtual
+  vector<monster*>& near(cell *c, hyperpoint h, ld maxval) {
+    static vector<monster*> res;
+    static vector<int> ids;
+    if(!on) return nonvirtual;
+    ids.clear();
+    queries++;
+    auto scan = [] (cell *c) { 
+      int i = find(c);
+      if(keys[i] && seen[i] != queries) {
+        seen[i] = queries;
+        for(int id = heads[i]; id >= 0; id = nxt[id]) ids.push_back(id);
+        }
+      };
+    scan(c);
+    if(ring >= 1) forCellEx(c1, c) {
+      scan(c1);
+      if(ring >= 2) forCellEx(c2, c1) scan(c2);
+      }
+    sort(ids.begin(), ids.end());
+    res.clear();
+    for(int id: ids) res.push_back(nonvirtual[id]);
+    candidates += isize(res);
+    if(verify) for(monster *m2: nonvirtual) 
+      if(intval(m2->pat*C0, h) < maxval && !binary_search(ids.begin(), ids.end(), m2->collid))
+        mismatches++;
+    return res;
+    }
+  }
+
 cell *findbaseAround(hyperpoint p, cell *around) {
   cell *best = around;
   double d0 = intval(p, ggmatrix(around) * C0);
@@ -1033,7 +1276,23 @@ cell *findbaseAroundRepeat(const transmatrix& H, cell *around) {
   } */
 
 void monster::store() {
-  monstersAt.insert(make_pair(base, this));
+  monstersAt::insert(this);
+  }
+
+void monstersAt::insert(monster *m) {
+  bucket& b = at(m->base);
+  m->nextAt = NULL;
+  if(b.last) b.last->nextAt = m;
+  else b.first = m;
+  b.last = m;
+  }
+
+template<class T> void monstersAt::forEach(const T& f) {
+  // f may store the monster again
+  vector<monster*> all;
+  for(auto& b: table) for(monster *m = b.first; m; m = m->nextAt) all.push_back(m);
+  for(monster *m = removed.first; m; m = m->nextAt) all.push_back(m);
+  for(monster *m: all) f(m);
   }
 
 void monster::findpat() {
@@ -1057,12 +1316,14 @@ void monster::rebasePat(const transmatrix& new_pat) {
     at = new_pat;
     virtualRebase(this, true);
     fixmatrix(at); pat = at;
+    collision::update(this);
     return;
     }
   if(among(geometry, gZebraQuotient, gTorus, gKleinQuartic, gBolza, gBolza2, gMinimal)) {
     at = inverse(gmatrix[base]) * new_pat;
     virtualRebase(this, true);
     fixmatrix(at);
+    collision::update(this);
     return;
     }
   pat = new_pat;
@@ -1072,9 +1333,31 @@ void monster::rebasePat(const transmatrix& new_pat) {
   at = inverse(gmatrix[c2]) * pat;
   fixmatrix(at);
   fixelliptic(at);
+  collision::update(this);
   }
 
-bool trackroute(monster *m, transmatrix goal, double spd) {
+// the version of findbaseAround for the intent threads: it never adds
+// to gmatrix, but sets unknown when it would have to
+cell *findbaseAroundKnown(hyperpoint p, cell *around, bool& unknown) {
+  cell *best = around;
+  auto it = gmatrix.find(around);
+  if(it == gmatrix.end() || it->second[2][2] == 0) { unknown = true; return around; }
+  double d0 = intval(p, it->second * C0);
+  for(int i=0; i<around->type; i++) {
+    cell *c2 = around->move(i);
+    if(c2) {
+      it = gmatrix.find(c2);
+      if(it == gmatrix.end() || it->second[2][2] == 0) { unknown = true; return around; }
+      double d1 = intval(p, it->second * C0);
+      if(d1 < d0) { best = c2; d0 = d1; }
+      }
+    }
+  return best;
+  }
+
+// with unknown given, gmatrix is not modified (and false is returned if
+// a matrix is missing)
+bool trackroute(monster *m, transmatrix goal, double spd, bool *unknown = NULL) {
   cell *c = m->base;
   
   // queuepoly(goal, shGrail, 0xFFFFFFC0);
@@ -1091,7 +1374,8 @@ bool trackroute(monster *m, transmatrix goal, double spd) {
 
     // queuepoly(nat, shKnife, 0xFFFFFFC0);
 
-    cell *c2 = findbaseAround(nat, c);
+    cell *c2 = unknown ? findbaseAroundKnown(tC0(nat), c, *unknown) : findbaseAround(nat, c);
+    if(unknown && *unknown) return false;
     if(c2 != c && !passable_for(m->type, c2, c, P_CHAIN | P_ONPLAYER)) {
       return false;
       }
@@ -1100,7 +1384,8 @@ bool trackroute(monster *m, transmatrix goal, double spd) {
   return true;
   }
 
-monster *pc[MAXPLAYER], *mousetarget, *lmousetarget;
+monster *pc[MAXPLAYER];
+monster_ref mousetarget, lmousetarget;
 
 int curtime, nextmove, nextdragon;
 
@@ -1432,7 +1717,19 @@ void activateArrow(cell *c) {
     traplist.emplace(ticks + 500, c);
   }
 
-monster arrowtrap_fakeparent;
+// the parent of the arrows, so that they do not hit each other
+monster *arrowtrap_fakeparent;
+
+monster *arrowtrapParent() {
+  if(!arrowtrap_fakeparent) {
+    arrowtrap_fakeparent = new monster;
+    arrowtrap_fakeparent->type = moNone;
+    arrowtrap_fakeparent->base = NULL;
+    arrowtrap_fakeparent->at = arrowtrap_fakeparent->pat = Id;
+    arrowtrap_fakeparent->pid = 0;
+    }
+  return arrowtrap_fakeparent;
+  }
 
 void doTraps() {
   while(true) { 
@@ -1452,7 +1749,7 @@ void doTraps() {
         bullet->base = tl[i];
         bullet->at = rspintox(inverse(tu) * tC0(tv));
         bullet->type = moArrowTrap;
-        bullet->parent = &arrowtrap_fakeparent;
+        bullet->parent = arrowtrapParent();
         bullet->pid = 0;
         bullet->parenttype = moArrowTrap;
         additional.push_back(bullet);
@@ -2021,7 +2318,8 @@ bool isPlayerOrImage(eMonster m) {
   }
 
 monster *parentOrSelf(monster *m) {
-  return m->parent ? m->parent : m;
+  monster *p = m->parent;
+  return p ? p : m;
   }
 
 bool verifyTeleport() {
@@ -2219,12 +2517,19 @@ void moveBullet(monster *m, int delta) {
 
   // items[itOrbWinter] = 100; items[itOrbLife] = 100;
   
-  if(!m->isVirtual) for(monster* m2: nonvirtual) {
+  // without the index, slayer was computed (and the orbs marked) for every 
+  // monster which is not skipped by the first check, so do the same here
+  eMonster ptype = parentOrSelf(m)->type;
+  bool slayer = false;
+  if(!m->isVirtual && collision::on && collision::has_targets(m)) 
+    slayer = m->type == moCrushball ||
+      (markOrb(itOrbSlaying) && (markOrb(itOrbEmpathy) ? isPlayerOrImage(ptype) : ptype == moPlayer));
+
+  if(!m->isVirtual) for(monster* m2: collision::near(m->base, m->pat*C0, SCALE2 * 0.1)) {
     if(m2 == m || (m2 == m->parent && m->vel >= 0) || m2->parent == m->parent) 
       continue;
 
-    eMonster ptype = parentOrSelf(m)->type;
-    bool slayer = m->type == moCrushball ||
+    if(!collision::on) slayer = m->type == moCrushball ||
       (markOrb(itOrbSlaying) && (markOrb(itOrbEmpathy) ? isPlayerOrImage(ptype) : ptype == moPlayer));
     
     // Flailers only killable by themselves
@@ -2316,7 +2621,7 @@ void moveBullet(monster *m, int delta) {
         }
       // Knights reflect bullets
       if(m2->type == moKnight) {
-        if(m->parent && m->parent != &arrowtrap_fakeparent) {
+        if(m->parent && m->parent != arrowtrap_fakeparent) {
           nat = nat * rspintox(inverse(m->pat) * m->parent->pat * C0);
           m->rebasePat(nat);
           }
@@ -2360,6 +2665,188 @@ bool dragonbreath(cell *dragon) {
 #define CHARGING (-777)
 #define BULLSTUN (1500)
 
+// how far m moves in delta ms (before the effects of stunning); beauty is
+// set if it has been slowed down by the Orb of Beauty
+double monsterStep(monster *m, int delta, bool& beauty) {
+  double step = SCALE * delta/1000.0;
+  if(m->type == moWitchSpeed)
+    step *= 2;
+  else if(m->type == moEagle)
+    step *= 1.6;
+  else if(m->type == moHunterDog)
+    step *= (1 + .5 / numplayers());
+  else if(m->type == moLancer)
+    step *= 1.25;
+  else if(isDemon(m->type))
+    step /= 2;
+  else if(m->type == moMetalBeast || m->type == moMetalBeast2) 
+    step /= 2;
+  else if(m->type == moTortoise && peace::on)
+    step = 0;
+  else if(m->type == moTortoise)
+    step /= 3;
+  else if(isBull(m->type))
+    step *= 1.5;
+  else if(m->type == moAltDemon || m->type == moHexDemon || m->type == moCrusher || m->type == moMonk)
+    step *= 1.4;
+
+  if(m->type == passive_switch) step = 0;
+  
+  beauty = false;
+  if(items[itOrbBeauty] && !m->isVirtual) {
+    for(int pid=0; pid<players; pid++) if(!pc[pid]->isVirtual) {
+      double dist = intval(pc[pid]->pat*C0, m->pat*C0);
+      if(dist < SCALE2) beauty = true;
+      }
+    if(beauty) step /= 2;
+    }
+  return step;
+  }
+
+// go towards the closest player which can be reached in a straight line
+void chasePlayers(monster *m, double step, bool *unknown, transmatrix& goal, bool& direct, int& directi) {
+  for(int i=0; i<players; i++) 
+    if(step && trackroute(m, pc[i]->pat, step, unknown) && (!direct || intval(pc[i]->pat*C0, m->pat*C0) < intval(goal*C0,m->pat*C0))) {
+      goal = pc[i]->pat;
+      direct = true;
+      directi = i;
+      // m->trackrouteView(pc->pat, step);
+      }
+  }
+
+// otherwise, follow the path data as far as the straight line goes
+void followPath(monster *m, double step, bool *unknown, transmatrix& goal, cell*& c) {
+  while(true) {
+    transmatrix T;
+    if(!unknown) T = gmatrix[c];
+    else if(gmatrix.count(c)) T = gmatrix.find(c)->second;
+    else { *unknown = true; return; }
+    if(step && trackroute(m, T, step, unknown))
+      goal = T;
+    if(unknown && *unknown) return;
+    cell *cnext = c;
+    for(int i=0; i<c->type; i++) {
+      cell *c2 = c->move(i);
+      if(c2 && gmatrix.count(c2) && c2->pathdist < c->pathdist &&
+        passable_for(m->type, c2, c, P_CHAIN | P_ONPLAYER))
+        cnext = c2;
+      }
+    if(cnext == c) break;
+    c = cnext;
+    }
+  }
+
+// the goals of the monsters of a movegroup are computed before any of them
+// moves: in parallel, since chasePlayers and followPath only read the world
+// (and give up when gmatrix would have to be extended). The monsters are then
+// moved in the usual order, and an intent is used only if the monster has not
+// been changed in the meantime; otherwise the goal is computed as before.
+namespace intents {
+  struct intent {
+    // what the intent has been computed from
+    cell *base;
+    eMonster type;
+    transmatrix pat;
+    double step;
+    // the result
+    transmatrix goal;
+    cell *c;
+    bool direct;
+    int directi;
+    bool known;
+    };
+  
+  // 0: compute the goals while moving, 1: use the intents, 
+  // 2: also compare with the intents computed by a single thread
+  int on = CAP_THREADS;
+  // 0 = std::thread::hardware_concurrency
+  int threads = 0;
+  int computed, used, unknown, stale, mismatches;
+  double phasetime;
+  
+  vector<intent> plan;
+  intent *current;
+  
+  bool eligible(monster *m) {
+    if(m->dead || m->isVirtual || peace::on) return false;
+    if(m->stunoff > curtime || m->blowoff > curtime) return false;
+    if(m->type == moRagingBull && m->stunoff == CHARGING) return false;
+    // these have their own goals, or change the world before choosing one
+    if(isBug(m->type) || m->type == moWolf || m->type == moHerdBull || m->type == moButterfly) return false;
+    if(m->type == moSleepBull || m->type == moWitchFlash) return false;
+    return true;
+    }
+  
+  void compute(monster *m, int delta, intent& it) {
+    it.base = m->base; it.type = m->type; it.pat = m->pat;
+    bool beauty;
+    it.step = monsterStep(m, delta, beauty);
+    it.c = m->base; it.direct = false; it.directi = 0;
+    bool unknown = !gmatrix.count(m->base);
+    if(!unknown) it.goal = gmatrix.find(m->base)->second;
+    if(!invismove && !unknown) chasePlayers(m, it.step, &unknown, it.goal, it.direct, it.directi);
+    if(!it.direct && !unknown) followPath(m, it.step, &unknown, it.goal, it.c);
+    it.known = !unknown;
+    }
+  
+  void compute(const vector<int>& todo, int from, int to, int delta) {
+    for(int i=from; i<to; i++) compute(nonvirtual[todo[i]], delta, plan[todo[i]]);
+    }
+  
+  bool same(const intent& a, const intent& b) {
+    if(a.known != b.known) return false;
+    if(!a.known) return true;
+    return a.c == b.c && a.direct == b.direct && a.directi == b.directi && 
+      memcmp(&a.goal, &b.goal, sizeof(transmatrix)) == 0;
+    }
+  
+  // compute the intents of the nonvirtual monsters in movegroup t
+  void prepare(int t, int delta) {
+    plan.resize(isize(nonvirtual));
+    for(auto& it: plan) it.base = NULL;
+    if(!on) return;
+    auto t0 = std::chrono::steady_clock::now();
+    vector<int> todo;
+    for(int i=0; i<isize(nonvirtual); i++)
+      if(movegroup(nonvirtual[i]->type) == t && eligible(nonvirtual[i]))
+        todo.push_back(i);
+    int n = isize(todo);
+#if CAP_THREADS
+    int k = threads ? threads : std::thread::hardware_concurrency();
+    if(k > 1 && n >= 2 * k) {
+      vector<std::thread> th;
+      for(int j=0; j<k; j++)
+        th.emplace_back([&todo, n, j, k, delta] { compute(todo, n * j / k, n * (j+1) / k, delta); });
+      for(auto& tt: th) tt.join();
+      }
+    else
+#endif
+    compute(todo, 0, n, delta);
+    computed += n;
+    for(int i: todo) if(!plan[i].known) unknown++;
+    if(on == 2) for(int i: todo) {
+      intent it;
+      compute(nonvirtual[i], delta, it);
+      if(!same(it, plan[i])) mismatches++;
+      }
+    phasetime += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    }
+  
+  // the intent of the monster being moved, if still valid
+  bool take(monster *m, double step, transmatrix& goal, cell*& c, bool& direct, int& directi) {
+    intent *it = current;
+    if(!it || !it->base) return false;
+    if(!it->known) return false;
+    if(it->base != m->base || it->type != m->type || it->step != step || memcmp(&it->pat, &m->pat, sizeof(transmatrix))) {
+      stale++;
+      return false;
+      }
+    goal = it->goal; c = it->c; direct = it->direct; directi = it->directi;
+    used++;
+    return true;
+    }
+  }
+
 void moveMonster(monster *m, int delta) {
 
   bool stunned = m->stunoff > curtime || m->blowoff > curtime;
@@ -2395,42 +2882,14 @@ void moveMonster(monster *m, int delta) {
   
   bool direct = false; // is there a direct path to the target?
   int directi = 0; // which player has direct path (to set as pid in missiles)
+  bool planned = false; // goal taken from the intent
   
-  double step = SCALE * delta/1000.0;
-  if(m->type == moWitchSpeed)
-    step *= 2;
-  else if(m->type == moEagle)
-    step *= 1.6;
-  else if(m->type == moHunterDog)
-    step *= (1 + .5 / numplayers());
-  else if(m->type == moLancer)
-    step *= 1.25;
-  else if(isDemon(m->type)) {
-    if(m->type == moLesserM) m->type = moLesser;
-    if(m->type == moGreaterM) m->type = moGreater;
-    step /= 2;
-    }
-  else if(m->type == moMetalBeast || m->type == moMetalBeast2) 
-    step /= 2;
-  else if(m->type == moTortoise && peace::on)
-    step = 0;
-  else if(m->type == moTortoise)
-    step /= 3;
-  else if(isBull(m->type))
-    step *= 1.5;
-  else if(m->type == moAltDemon || m->type == moHexDemon || m->type == moCrusher || m->type == moMonk)
-    step *= 1.4;
-
-  if(m->type == passive_switch) step = 0;
+  if(m->type == moLesserM) m->type = moLesser;
+  if(m->type == moGreaterM) m->type = moGreater;
   
-  if(items[itOrbBeauty] && !m->isVirtual) {
-    bool nearplayer = false;
-    for(int pid=0; pid<players; pid++) if(!pc[pid]->isVirtual) {
-      double dist = intval(pc[pid]->pat*C0, m->pat*C0);
-      if(dist < SCALE2) nearplayer = true;
-      }
-    if(nearplayer) markOrb(itOrbBeauty), step /= 2;
-    }
+  bool beauty;
+  double step = monsterStep(m, delta, beauty);
+  if(beauty) markOrb(itOrbBeauty);
 
   if(m->isVirtual) return;
   transmatrix nat = m->pat;
@@ -2535,29 +2994,12 @@ void moveMonster(monster *m, int delta) {
         directi = 0;
         }
       }
-    else if(!direct && !invismove && !peace::on) {
-      for(int i=0; i<players; i++) 
-        if(step && trackroute(m, pc[i]->pat, step) && (!direct || intval(pc[i]->pat*C0, m->pat*C0) < intval(goal*C0,m->pat*C0))) {
-          goal = pc[i]->pat;
-          direct = true;
-          directi = i;
-          // m->trackrouteView(pc->pat, step);
-          }
-        }
+    else if(intents::take(m, step, goal, c, direct, directi)) 
+      planned = true;
+    else if(!direct && !invismove && !peace::on)
+      chasePlayers(m, step, NULL, goal, direct, directi);
   
-    if(!direct && !peace::on) while(true) {
-      if(step && trackroute(m, gmatrix[c], step))
-        goal = gmatrix[c];
-      cell *cnext = c;
-      for(int i=0; i<c->type; i++) {
-        cell *c2 = c->move(i);
-        if(c2 && gmatrix.count(c2) && c2->pathdist < c->pathdist &&
-          passable_for(m->type, c2, c, P_CHAIN | P_ONPLAYER))
-          cnext = c2;
-        }
-      if(cnext == c) break;
-      c = cnext;
-      }
+    if(!direct && !peace::on && !planned) followPath(m, step, NULL, goal, c);
 
     if(m->type == moHedge) {
       hyperpoint h = inverse(m->pat) * goal * C0;
@@ -2631,7 +3073,9 @@ void moveMonster(monster *m, int delta) {
 
   monster* crashintomon = NULL;
   
-  if(!m->isVirtual) for(monster *m2: nonvirtual) if(m2!=m && m2->type != moBullet && m2->type != moArrowTrap) {
+  if(!m->isVirtual) 
+  for(monster *m2: collision::near(findbaseAround(nat, m->base), nat*C0, SCALE2 * 0.1)) 
+  if(m2!=m && m2->type != moBullet && m2->type != moArrowTrap) {
     double d = intval(m2->pat*C0, nat*C0);
     if(d < SCALE2 * 0.1) crashintomon = m2;
     }
@@ -2900,15 +3344,8 @@ void moveMonster(monster *m, int delta) {
   }
 
 void activateMonstersAt(cell *c) {
-  pair<mit, mit> p = 
-    monstersAt.equal_range(c);
-  for(mit it = p.first; it != p.second;) {
-    mit itplus = it;
-    itplus++;
-    active.push_back(it->second);
-    monstersAt.erase(it);
-    it = itplus;
-    }
+  for(monster *m = monstersAt::take(c); m; m = m->nextAt)
+    active.push_back(m);
   if(c->monst && isMimic(c->monst)) c->monst = moNone;
   // mimics are awakened by awakenMimics
   if(c->monst && !isIvy(c) && !isWorm(c) && !isMutantIvy(c) && !isKraken(c->monst) && c->monst != moPrincess && c->monst != moHunterGuard) {
@@ -2932,14 +3369,65 @@ void fixStorage() {
 
   vector<monster*> restore;
 
-  for(auto it = monstersAt.begin(); it != monstersAt.end(); it++) 
-    restore.push_back(it->second);
+  monstersAt::forEach([&] (monster *m) { restore.push_back(m); });
 
-  monstersAt.clear();
+  monstersAt::clear();
 
   for(monster *m: restore) m->store();
   }
 
+// the fixed-timestep simulation: the frame times are accumulated, and turn()
+// is called in steps of 'length' ms, at most 'maxsteps' per frame (the steps
+// which do not fit are dropped); the monsters are drawn between their poses
+// from the last two steps
+namespace fixedstep {
+  // 0 = one turn per frame, with the frame time
+  int length = 0;
+  int maxsteps = 4;
+  // the simulation time not played yet, in ms
+  int backlog;
+  int stepid;
+  bool stepping;
+  // how far between the last two steps the display is
+  ld alpha = 1;
+  int steps, dropped, frames;
+  
+  bool interpolated(monster *m) {
+    return length && m->prevstep == stepid && alpha < 1;
+    }
+
+  // the fraction t of the motion from Id to T
+  transmatrix between(const transmatrix& T, ld t) {
+    hyperpoint h = tC0(T);
+    ld d = hdist0(h);
+    // teleported, or mirrored: do not interpolate
+    if(d > 1 || det(T) < 0) return Id;
+    transmatrix R = rspintox(h) * xpush(d) * spintox(h);
+    R = inverse(R) * T;
+    ld a = atan2(R[0][1], R[0][0]);
+    return rspintox(h) * xpush(d * t) * spintox(h) * spin(a * t);
+    }
+  }
+
+void advance(int delta) {
+  using namespace fixedstep;
+  if(!length || !on) { turn(delta); return; }
+  frames++;
+  backlog += delta;
+  int n = 0;
+  while(backlog >= length && n < maxsteps) {
+    stepid++; stepping = true;
+    turn(length);
+    stepping = false;
+    backlog -= length; n++; steps++;
+    }
+  if(backlog >= length) {
+    dropped += backlog / length;
+    backlog %= length;
+    }
+  alpha = backlog * 1. / length;
+  }
+
 hookset<bool(int)> *hooks_turn;
 
 void turn(int delta) {
@@ -2970,8 +3458,8 @@ void turn(int delta) {
     for(unordered_map<cell*, transmatrix>::iterator it = gmatrix.begin(); it != gmatrix.end(); it++) 
       activateMonstersAt(it->first);
   
-  /* printf("size: gmatrix = %ld, active = %ld, monstersAt = %ld, delta = %d\n", 
-    gmatrix.size(), active.size(), monstersAt.size(),
+  /* printf("size: gmatrix = %ld, active = %ld, monstersAt = %d, delta = %d\n", 
+    gmatrix.size(), active.size(), monstersAt::used,
     delta); */
   
   bool exists[motypes];
@@ -2985,6 +3473,10 @@ void turn(int delta) {
     else nonvirtual.push_back(m);
     exists[movegroup(m->type)] = true;
     }
+  // remember the poses, to compute prevrel at the end of the step
+  if(fixedstep::stepping) for(monster *m: nonvirtual)
+    m->prevrel = m->pat, m->prevstep = fixedstep::stepid;
+  if(collision::on) collision::build();
   
   for(monster *m: active) {
     
@@ -3000,6 +3492,7 @@ void turn(int delta) {
       
       default: ;
       }
+    collision::update(m);
     }
 
   for(monster *m: active) {
@@ -3035,9 +3528,14 @@ void turn(int delta) {
   
     // move monsters of this type
     
-    for(monster *m: nonvirtual)
-      if(movegroup(m->type) == t)
-        moveMonster(m, delta);
+    intents::prepare(t, delta);
+    for(int i=0; i<isize(nonvirtual); i++) {
+      monster *m = nonvirtual[i];
+      if(movegroup(m->type) != t) continue;
+      intents::current = &intents::plan[i];
+      moveMonster(m, delta), collision::update(m);
+      intents::current = NULL;
+      }
     }
   
   if(shmup::on) {
@@ -3147,11 +3645,27 @@ void turn(int delta) {
     active.push_back(m);
   additional.clear();
   
+  if(fixedstep::stepping) for(monster *m: active) 
+    if(m->prevstep == fixedstep::stepid) {
+      if(m->isVirtual) m->prevstep = -1;
+      else m->prevrel = inverse(m->pat) * m->prevrel;
+      }
+  
+  // the missiles of the monsters which have died now get their closest
+  // living ancestor as the parent
+  for(monster *m: active) if(!m->dead || m->type == moPlayer) {
+    monster *p = m->parent;
+    if(!p || !p->dead || p->type == moPlayer) continue;
+    while(p && p->dead && p->type != moPlayer) {
+      monster *q = p->parent;
+      p = q == p ? NULL : q;
+      }
+    m->parent = p;
+    }
+  
   // deactivate all monsters
   for(monster *m: active)
     if(m->dead && m->type != moPlayer) {
-      for(monster *m2: active) if(m2->parent == m)
-        m2->parent = m->parent;
       if(m == mousetarget) mousetarget = NULL;
       if(m == lmousetarget) lmousetarget = NULL;
       delete m;
@@ -3209,12 +3723,8 @@ void init() {
   }
 
 bool boatAt(cell *c) {
-  pair<mit, mit> p = 
-    monstersAt.equal_range(c);
-  for(mit it = p.first; it != p.second; it++) {
-    monster* m = it->second;
+  for(monster *m = monstersAt::first(c); m; m = m->nextAt)
     if(m->inBoat) return true;
-    }
   return false;
   }
 
@@ -3222,19 +3732,20 @@ hookset<bool(const transmatrix&, cell*, shmup::monster*)> *hooks_draw;
 
 bool drawMonster(const transmatrix& V, cell *c, const transmatrix*& Vboat, transmatrix& Vboat0, const transmatrix *Vdp) {
 
-  pair<mit, mit> p = 
-    monstersAt.equal_range(c);
+  monster *first = monstersAt::first(c);
     
-  if(p.first == p.second) return false;
+  if(!first) return false;
   ld zlev = -geom3::factor_to_lev(zlevel(tC0((*Vdp))));
    
   vector<monster*> monsters;
 
-  for(mit it = p.first; it != p.second; it++) {
-    monster* m = it->second;
+  for(monster *m = first; m; m = m->nextAt) {
     if(c != m->base) continue; // may happen in RogueViz Collatz
     m->pat = ggmatrix(m->base) * m->at;
     transmatrix view = V * m->at;
+    transmatrix shift = Id;
+    if(fixedstep::interpolated(m)) 
+      view = view * (shift = fixedstep::between(m->prevrel, 1 - fixedstep::alpha));
     
     if(!mouseout()) {
       if(m->no_targetting) ; else
@@ -3244,15 +3755,15 @@ bool drawMonster(const transmatrix& V, cell *c, const transmatrix*& Vboat, trans
       }
     
     if(m->inBoat) {
-      view = m->pat;
+      view = m->pat * shift;
       Vboat = &(Vboat0 = view);
       if(m->type == moPlayer && items[itOrbWater]) {
-        queuepoly(m->pat, shBoatOuter, watercolor(0));
-        queuepoly(m->pat, shBoatInner, 0x0060C0FF);
+        queuepoly(view, shBoatOuter, watercolor(0));
+        queuepoly(view, shBoatInner, 0x0060C0FF);
         }
       else {
-        queuepoly(m->pat, shBoatOuter, 0xC06000FF);
-        queuepoly(m->pat, shBoatInner, 0x804000FF);
+        queuepoly(view, shBoatOuter, 0xC06000FF);
+        queuepoly(view, shBoatInner, 0x804000FF);
         }
       }
 
@@ -3351,12 +3862,11 @@ bool drawMonster(const transmatrix& V, cell *c, const transmatrix*& Vboat, trans
   }
 
 void clearMonsters() {
-  for(mit it = monstersAt.begin(); it != monstersAt.end(); it++)
-    delete(it->second);
+  monstersAt::forEach([] (monster *m) { delete m; });
   for(monster *m: active) delete m;
   mousetarget = NULL;
   lmousetarget = NULL;
-  monstersAt.clear();
+  monstersAt::clear();
   active.clear();
   }
 
@@ -3427,16 +3937,123 @@ void addShmupHelp(string& out) {
     }
   }
 
+#if CAP_COMMANDLINE
+int benchdelta = 20;
+
+// keep about q monsters of type mt and qb bullets (in random directions)
+// on the screen, and play t frames of benchdelta ms; print the time of 
+// advance() and the collision statistics
+void bench(int q, int qb, int t, eMonster mt) {
+  if(!on) { printf("benchshmup: not in the shmup mode\n"); return; }
+  if(masterless || binarytiling || archimedean) { printf("benchshmup: not supported in this geometry\n"); return; }
+  std::mt19937 gen(startseed);
+  auto rnd = [&] (ld a) { return a * (gen() & 0xFFFF) / 65536; };
+  collision::queries = collision::candidates = collision::mismatches = 0;
+  pool::resetCounters();
+  intents::computed = intents::used = intents::unknown = intents::stale = intents::mismatches = 0;
+  intents::phasetime = 0;
+  fixedstep::steps = fixedstep::dropped = fixedstep::frames = 0;
+  double total = 0;
+  long long nonvirtuals = 0;
+  int ticks;
+  for(ticks=0; ticks<t; ticks++) {
+    // compute gmatrix only
+    gmatrix.clear(); cells_drawn = 0;
+    compute_graphical_distance();
+    just_gmatrix = true; drawStandard(); just_gmatrix = false;
+    vector<cell*> cells;
+    for(auto& p: gmatrix) if(passable(p.first, NULL, 0)) cells.push_back(p.first);
+    if(cells.empty()) break;
+    int haveq = 0, haveb = 0;
+    monstersAt::forEach([&] (monster *m) { 
+      if(m->dead) ;
+      else if(m->type == mt) haveq++;
+      else if(m->type == moBullet) haveb++;
+      });
+    for(; haveq < q; haveq++) {
+      monster *m = new monster;
+      m->base = cells[gen() % isize(cells)];
+      m->at = spin(rnd(2*M_PI)) * xpush(rnd(.2));
+      m->type = mt;
+      m->store();
+      }
+    for(; haveb < qb; haveb++) {
+      monster *m = new monster;
+      m->base = cells[gen() % isize(cells)];
+      m->at = spin(rnd(2*M_PI)) * xpush(rnd(.2));
+      m->type = moBullet; m->parenttype = moNone; m->pid = 0;
+      m->store();
+      }
+    auto t0 = std::chrono::steady_clock::now();
+    advance(benchdelta);
+    total += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    nonvirtuals += isize(nonvirtual);
+    }
+  printf("benchshmup: %d ticks, %.1f nonvirtual, %.3f ms per tick, %.1f ticks/s, %d queries, %.1f candidates per query, %d mismatches\n",
+    ticks, nonvirtuals * 1. / max(ticks, 1), total * 1000 / max(ticks, 1), ticks / max(total, 1e-9), 
+    collision::queries, collision::candidates * 1. / max(collision::queries, 1), collision::mismatches);
+  printf("benchshmup pool: %.1f allocations per tick, %d reused, %d live, %d peak live, %d slots, %d stale accesses\n",
+    pool::allocs * 1. / max(ticks, 1), pool::reused, pool::live, pool::peak, isize(pool::chunks) * pool::chunksize, pool::stale);
+  printf("benchshmup intents: %d computed, %d used, %d unknown, %d stale, %d mismatches, %.3f ms per tick in the intent phase\n",
+    intents::computed, intents::used, intents::unknown, intents::stale, intents::mismatches, intents::phasetime * 1000 / max(ticks, 1));
+  if(fixedstep::length)
+    printf("benchshmup steps: %d steps of %d ms, %.1f steps per game second, %.1f steps per second, %d dropped\n",
+      fixedstep::steps, fixedstep::length, fixedstep::steps * 1000. / max(ticks * benchdelta, 1), 
+      fixedstep::steps / max(total, 1e-9), fixedstep::dropped);
+  }
+
+int readArgs() {
+  using namespace arg;
+  if(0) ;
+  else if(argis("-shmupgrid")) {
+    // -shmupgrid 0: check all the pairs, 1: use the collision buckets, 
+    // 2: also count the collisions missed by the buckets
+    shift(); int i = argi(); collision::on = i; collision::verify = i == 2;
+    }
+  else if(argis("-shmupring")) {
+    shift(); collision::ring = argi();
+    }
+  else if(argis("-shmupintents")) {
+    // -shmupintents 0: compute the goals while moving, 1: in the intent phase,
+    // 2: also count the intents which differ from the single-threaded ones
+    shift(); intents::on = argi();
+    }
+  else if(argis("-shmupstep")) {
+    // -shmupstep 10 4: simulate in steps of 10 ms, at most 4 of them per frame
+    shift(); fixedstep::length = argi(); shift(); fixedstep::maxsteps = argi();
+    }
+  else if(argis("-benchdelta")) {
+    // the frame time in -benchshmup
+    shift(); benchdelta = argi();
+    }
+  else if(argis("-shmupthreads")) {
+    // the number of threads for the intent phase (0 = all the cores)
+    shift(); intents::threads = argi();
+    }
+  else if(argis("-benchshmup")) {
+    // example: hyper -nogui -fixx 1 -S -W Crossroads -I Shield 100000 -benchshmup 2000 2000 500 Goblin -exit
+    PHASEFROM(3); shift(); int q = argi(); shift(); int qb = argi(); shift(); int t = argi();
+    shift(); bench(q, qb, t, readMonster(args()));
+    }
+  else return 1;
+  return 0;
+  }
+
+auto hookArg = addHook(hooks_args, 100, readArgs);
+#endif
+
 auto hooks = addHook(clearmemory, 0, shmup::clearMemory) +
   addHook(hooks_removecells, 0, [] () {
-    for(mit it = monstersAt.begin(); it != monstersAt.end();) {
-      if(is_cell_removed(it->first)) {
-        monstersAt.insert(make_pair(nullptr, it->second));
-        auto it0 = it; it++;
-        monstersAt.erase(it0);
+    using namespace monstersAt;
+    for(auto& b: table) if(b.c && is_cell_removed(b.c)) {
+      if(b.first) {
+        if(removed.last) removed.last->nextAt = b.first;
+        else removed.first = b.first;
+        removed.last = b.last;
         }
-      else it++;
+      b.first = b.last = NULL;
       }
+    rehash(isize(table));
     });
     
 }
@@ -0,0 +1,462 @@
+// Hyperbolic Rogue -- map snapshots
+// Copyright (C) 2011-2018 Zeno Rogue, see 'hyper.cpp' for details
+
+// A snapshot stores the generated map in a file which can be mapped back
+// into memory, so that large regions do not have to be generated again.
+//
+// The file consists of a header (written with hwrite), padded to SLAB_SIZE,
+// followed by the slabs of the arena of the map. In the slabs, the pointers
+// (and the handles, if CAP_COMPRESSED_MOVES) are replaced by positions in the
+// file. They are followed by the positions of all the heptagons and cells.
+// Loading maps the slabs (copy-on-write) and adds the base address to the
+// pointers, without parsing the cells.
+//
+// Alternate maps (horocycles etc.) are not stored: the 'alt' pointers are
+// cleared, so big structures will not be continued in cells generated later.
+//
+// For bounded maps (quotient spaces and tori) the topology is rebuilt by the
+// map constructor, and only the contents of the cells are taken from the file.
+
+namespace hr {
+
+#if CAP_SNAPSHOT
+namespace snapshot {
+
+static const int version = 1;
+
+enum eKind { skNone, skHyperbolic, skEuclidean, skBounded };
+
+eKind current_kind() {
+  if(IRREGULAR || archimedean || binarytiling || geometry == gCrystal || sphere) return skNone;
+  if(!(PURE || BITRUNCATED)) return skNone;
+  if(fulltorus || quotient) return skBounded;
+  if(euclid) return skEuclidean;
+  return skHyperbolic;
+  }
+
+struct header_info {
+  string magic;
+  int version, ptrsize, cellsize, heptsize, compressed, slabsize;
+  eGeometry geometry;
+  eVariation variation;
+  eKind kind;
+  long long slabs, hcount, ccount;
+  long long origin, start;
+  int spin;
+  bool mirrored;
+  };
+
+void write_header(hstream& hs, const header_info& hd) {
+  hwrite(hs, hd.magic, hd.version, hd.ptrsize, hd.cellsize, hd.heptsize, hd.compressed, hd.slabsize);
+  hwrite(hs, hd.geometry, hd.variation, hd.kind);
+  hwrite(hs, hd.slabs, hd.hcount, hd.ccount, hd.origin, hd.start, hd.spin, hd.mirrored);
+  }
+
+void read_header(hstream& hs, header_info& hd) {
+  hread(hs, hd.magic, hd.version, hd.ptrsize, hd.cellsize, hd.heptsize, hd.compressed, hd.slabsize);
+  hread(hs, hd.geometry, hd.variation, hd.kind);
+  hread(hs, hd.slabs, hd.hcount, hd.ccount, hd.origin, hd.start, hd.spin, hd.mirrored);
+  }
+
+static const int SLAB_SIZE = slab_arena::SLAB_SIZE;
+
+long long round_to_slab(long long x) { return (x + SLAB_SIZE - 1) / SLAB_SIZE * SLAB_SIZE; }
+
+// --- saving ---
+
+map<char*, int> slab_id;
+
+uintptr_t encode(void *p) {
+  if(!p) return 0;
+  char *s = (char*) slab_arena::header_of(p);
+  return uintptr_t(slab_id.at(s)) * SLAB_SIZE + ((char*)p - s);
+  }
+
+template<class T> void put(char *buf, void *obj, T& field, uintptr_t val) {
+  memcpy(buf + ((char*)&field - (char*)obj), &val, sizeof(field));
+  }
+
+template<class T> void put_moves(char *buf, T *obj, int qty) {
+  for(int i=0; i<qty; i++) {
+    #if CAP_COMPRESSED_MOVES
+    uint32_t h = 0;
+    void *p = obj->move(i);
+    if(p) {
+      char *s = (char*) slab_arena::header_of(p);
+      h = (uint32_t(slab_id.at(s)) << HANDLE_BITS) | uint32_t(((char*)p - s) / slab_arena::GRANULE);
+      }
+    memcpy(buf + ((char*)&obj->c.move_table[i] - (char*)obj), &h, sizeof(h));
+    #else
+    put(buf, obj, obj->c.move_table[i], encode(obj->move(i)));
+    #endif
+    }
+  }
+
+void list_objects(eKind kind, vector<heptagon*>& hepts, vector<cell*>& cells) {
+  if(kind == skHyperbolic) {
+    heptagon *origin = currentmap->getOrigin();
+    hepts.push_back(origin);
+    // the heptagons form a tree, where move(0) goes to the parent
+    for(int i=0; i<isize(hepts); i++) {
+      heptagon *h = hepts[i];
+      for(int d=0; d<S7; d++) {
+        heptagon *h2 = h->move(d);
+        if(h2 && h2 != origin && h2->move(0) == h && h->c.spin(d) == 0)
+          hepts.push_back(h2);
+        }
+      }
+    for(heptagon *h: hepts) {
+      cell *c = h->c7;
+      cells.push_back(c);
+      // hexagons are created by the central cell of their master
+      if(BITRUNCATED) for(int d=0; d<c->type; d++) {
+        cell *c2 = c->move(d);
+        if(c2 && c2 != c && c2->master == h) cells.push_back(c2);
+        }
+      }
+    }
+  else if(kind == skEuclidean) {
+    auto m = dynamic_cast<hrmap_euclidean*> (currentmap);
+    for(int y=0; y<m->slabs; y++) for(int x=0; x<m->slabs; x++)
+      if(m->euclidean[y][x])
+        for(int y1=0; y1<256; y1++) for(int x1=0; x1<256; x1++)
+          if(m->euclidean[y][x]->a[y1][x1])
+            cells.push_back(m->euclidean[y][x]->a[y1][x1]);
+    }
+  else cells = currentmap->allcells();
+  }
+
+bool save(const string& fname) {
+  eKind kind = current_kind();
+  if(kind == skNone) {
+    printf("snapshot: not supported in this geometry\n");
+    return false;
+    }
+  slab_arena *a = currentmap->arena;
+  if(!a) {
+    printf("snapshot: the map has no arena\n");
+    return false;
+    }
+
+  vector<heptagon*> hepts;
+  vector<cell*> cells;
+  list_objects(kind, hepts, cells);
+
+  vector<char*> slabs = a->slabs;
+  for(int i=0; i<a->mapped_slabs; i++) slabs.push_back(a->mapped + i * SLAB_SIZE);
+  slab_id.clear();
+  for(int i=0; i<isize(slabs); i++) slab_id[slabs[i]] = i;
+
+  header_info hd;
+  hd.magic = "HyperRogue map snapshot";
+  hd.version = version;
+  hd.ptrsize = sizeof(void*);
+  hd.cellsize = sizeof(cell);
+  hd.heptsize = sizeof(heptagon);
+  hd.compressed = CAP_COMPRESSED_MOVES;
+  hd.slabsize = SLAB_SIZE;
+  hd.geometry = geometry;
+  hd.variation = variation;
+  hd.kind = kind;
+  hd.slabs = kind == skBounded ? 0 : isize(slabs);
+  hd.hcount = isize(hepts);
+  hd.ccount = isize(cells);
+  hd.origin = kind == skHyperbolic ? encode(currentmap->getOrigin()) : 0;
+  if(kind == skBounded) {
+    hd.start = 0;
+    for(int i=0; i<isize(cells); i++) if(cells[i] == cwt.at) hd.start = i;
+    }
+  else hd.start = encode(cwt.at);
+  hd.spin = cwt.spin;
+  hd.mirrored = cwt.mirrored;
+
+  fhstream f(fname, "wb");
+  if(!f.f) {
+    printf("snapshot: could not open %s\n", fname.c_str());
+    return false;
+    }
+
+  try {
+    write_header(f, hd);
+    if(kind == skEuclidean) {
+      auto m = dynamic_cast<hrmap_euclidean*> (currentmap);
+      hwrite<int>(f, isize(m->eucdata));
+      for(auto& p: m->eucdata) {
+        hwrite(f, p.first, p.second.bits);
+        for(int i=0; i<4; i++) hwrite(f, p.second.val[i]);
+        }
+      }
+    long long pos = ftell(f.f);
+    for(; pos < round_to_slab(pos); pos++) f.write_char(0);
+
+    if(kind == skBounded) {
+      for(cell *c: cells) {
+        f.write_chars((char*) (gcell*) c, sizeof(gcell));
+        }
+      printf("snapshot: saved %d cells to %s\n", isize(cells), fname.c_str());
+      return true;
+      }
+
+    for(auto h: hepts) if(slab_arena::owner(h) != a) {
+      printf("snapshot: found a heptagon outside of the map arena\n");
+      return false;
+      }
+    for(auto c: cells) if(slab_arena::owner(c) != a) {
+      printf("snapshot: found a cell outside of the map arena\n");
+      return false;
+      }
+
+    // the objects, by their position in the file
+    vector<uintptr_t> hpos, cpos;
+    for(auto h: hepts) hpos.push_back(encode(h));
+    for(auto c: cells) cpos.push_back(encode(c));
+    sort(hpos.begin(), hpos.end());
+    sort(cpos.begin(), cpos.end());
+
+    vector<char> buf(SLAB_SIZE);
+    int hi = 0, ci = 0;
+    for(int k=0; k<isize(slabs); k++) {
+      char *slab = slabs[k];
+      memcpy(&buf[0], slab, SLAB_SIZE);
+      uintptr_t limit = uintptr_t(k+1) * SLAB_SIZE;
+      for(; hi < isize(hpos) && hpos[hi] < limit; hi++) {
+        heptagon *h = (heptagon*) (slab + hpos[hi] % SLAB_SIZE);
+        char *b = &buf[hpos[hi] % SLAB_SIZE];
+        put_moves(b, h, h->degree());
+        put(b, h, h->c7, encode(h->c7));
+        put(b, h, h->alt, 0);
+        put(b, h, h->cdata, slab_id.count((char*) slab_arena::header_of(h->cdata)) ? encode(h->cdata) : 0);
+        }
+      for(; ci < isize(cpos) && cpos[ci] < limit; ci++) {
+        cell *c = (cell*) (slab + cpos[ci] % SLAB_SIZE);
+        char *b = &buf[cpos[ci] % SLAB_SIZE];
+        put_moves(b, c, c->type);
+        if(kind == skHyperbolic) put(b, c, c->master, encode(c->master));
+        put(b, c, c->listindex, uintptr_t(-1));
+        put(b, c, c->bfs_stamp, 0);
+        }
+      f.write_chars(&buf[0], SLAB_SIZE);
+      }
+
+    if(isize(hpos)) f.write_chars((char*) &hpos[0], hpos.size() * sizeof(uintptr_t));
+    if(isize(cpos)) f.write_chars((char*) &cpos[0], cpos.size() * sizeof(uintptr_t));
+    }
+  catch(hstream_exception& e) {
+    printf("snapshot: error while writing %s\n", fname.c_str());
+    return false;
+    }
+
+  printf("snapshot: saved %d heptagons and %d cells (%d slabs) to %s\n", isize(hepts), isize(cells), isize(slabs), fname.c_str());
+  return true;
+  }
+
+// --- loading ---
+
+string pending;
+header_info hd;
+long long data_offset;
+map<int, cdata> pending_eucdata;
+
+bool read_info(const string& fname) {
+  fhstream f(fname, "rb");
+  if(!f.f) {
+    printf("snapshot: could not open %s\n", fname.c_str());
+    return false;
+    }
+  try {
+    read_header(f, hd);
+    if(hd.magic != "HyperRogue map snapshot" || hd.version != version) {
+      printf("snapshot: %s is not a snapshot of this version\n", fname.c_str());
+      return false;
+      }
+    if(hd.ptrsize != int(sizeof(void*)) || hd.cellsize != int(sizeof(cell)) || hd.heptsize != int(sizeof(heptagon)) ||
+      hd.compressed != CAP_COMPRESSED_MOVES || hd.slabsize != SLAB_SIZE) {
+      printf("snapshot: %s was saved by an incompatible build\n", fname.c_str());
+      return false;
+      }
+    pending_eucdata.clear();
+    if(hd.kind == skEuclidean) {
+      int q = f.get<int>();
+      for(int i=0; i<q; i++) {
+        int id = f.get<int>();
+        cdata& d = pending_eucdata[id];
+        hread(f, d.bits);
+        for(int i=0; i<4; i++) hread(f, d.val[i]);
+        }
+      }
+    data_offset = round_to_slab(ftell(f.f));
+    }
+  catch(hstream_exception& e) {
+    printf("snapshot: %s is truncated\n", fname.c_str());
+    return false;
+    }
+  return true;
+  }
+
+// map the data part of the file at a SLAB_SIZE-aligned address (as required by
+// slab_arena::header_of); returns NULL on failure, or if the file is too short
+char *map_data(const string& fname, size_t len) {
+  int fd = open(fname.c_str(), O_RDONLY);
+  if(fd < 0) return NULL;
+  struct stat st;
+  if(fstat(fd, &st) < 0 || (long long) st.st_size < data_offset + (long long) len) {
+    printf("snapshot: %s is truncated\n", fname.c_str());
+    close(fd);
+    return NULL;
+    }
+  size_t page = sysconf(_SC_PAGESIZE);
+  size_t maplen = (len + page - 1) / page * page;
+  char *res = (char*) mmap(NULL, maplen + SLAB_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if(res == MAP_FAILED) { close(fd); return NULL; }
+  char *base = (char*) round_to_slab((uintptr_t) res);
+  void *m = mmap(base, maplen, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, data_offset);
+  close(fd);
+  if(m == MAP_FAILED) { munmap(res, maplen + SLAB_SIZE); return NULL; }
+  if(base > res) munmap(res, base - res);
+  if(res + SLAB_SIZE > base) munmap(base + maplen, res + SLAB_SIZE - base);
+  return base;
+  }
+
+char *base;
+vector<int> slab_index;
+
+template<class T> void relocate(T*& p) {
+  if(p) p = (T*) (base + (uintptr_t) p);
+  }
+
+template<class T> void relocate_moves(T *obj, int qty) {
+  for(int i=0; i<qty; i++) {
+    #if CAP_COMPRESSED_MOVES
+    uint32_t& h = obj->c.move_table[i];
+    if(h) h = (uint32_t(slab_index[h >> HANDLE_BITS]) << HANDLE_BITS) | (h & ((1<<HANDLE_BITS)-1));
+    #else
+    relocate(obj->c.move_table[i]);
+    #endif
+    }
+  }
+
+hrmap *load_bounded(char *data) {
+  hrmap *m;
+  if(fulltorus) m = new hrmap_torus;
+  else m = new quotientspace::hrmap_quotient;
+  auto& ac = m->allcells();
+  if(isize(ac) != hd.ccount) {
+    printf("snapshot: the number of cells does not match (%d vs %lld)\n", isize(ac), hd.ccount);
+    delete m;
+    return NULL;
+    }
+  for(int i=0; i<isize(ac); i++)
+    memcpy((void*) (gcell*) ac[i], data + i * sizeof(gcell), sizeof(gcell));
+  return m;
+  }
+
+hrmap *load_map() {
+  if(pending == "") return NULL;
+  if(geometry != hd.geometry || variation != hd.variation || current_kind() != hd.kind) {
+    printf("snapshot: wrong geometry\n");
+    return NULL;
+    }
+
+  size_t len =
+    hd.kind == skBounded ? size_t(hd.ccount) * sizeof(gcell) :
+    size_t(hd.slabs) * SLAB_SIZE + size_t(hd.hcount + hd.ccount) * sizeof(uintptr_t);
+
+  int t0 = SDL_GetTicks();
+  base = map_data(pending, len);
+  if(!base) {
+    printf("snapshot: could not map %s\n", pending.c_str());
+    return NULL;
+    }
+
+  if(hd.kind == skBounded) {
+    hrmap *m = load_bounded(base);
+    munmap(base, len);
+    // keep the normal start in the map created by initcells
+    if(!m) base = NULL;
+    return m;
+    }
+
+  slab_arena *a = get_arena();
+  a->mapped = base;
+  a->mapped_slabs = hd.slabs;
+  slab_index.resize(hd.slabs);
+  for(int k=0; k<hd.slabs; k++) {
+    char *slab = base + k * SLAB_SIZE;
+    a->init_slab(slab, slab_arena::header_of(slab)->size);
+    slab_index[k] = slab_arena::header_of(slab)->index;
+    }
+
+  hrmap *m;
+  hrmap_euclidean *e = NULL;
+  if(hd.kind == skEuclidean) {
+    m = e = new hrmap_euclidean;
+    e->eucdata = pending_eucdata;
+    }
+  else m = new hrmap_hyperbolic((heptagon*) (base + hd.origin));
+
+  uintptr_t *index = (uintptr_t*) (base + hd.slabs * SLAB_SIZE);
+  for(int i=0; i<hd.hcount; i++) {
+    heptagon *h = (heptagon*) (base + index[i]);
+    relocate_moves(h, h->degree());
+    relocate(h->c7);
+    relocate(h->cdata);
+    }
+  index += hd.hcount;
+  for(int i=0; i<hd.ccount; i++) {
+    cell *c = (cell*) (base + index[i]);
+    relocate_moves(c, c->type);
+    if(e) *(e->at(decodeId(c->master)).first) = c;
+    else relocate(c->master);
+    }
+  // the positions are no longer needed
+  munmap(base + hd.slabs * SLAB_SIZE, len - hd.slabs * SLAB_SIZE);
+
+  a->live[0] += hd.hcount; heptacount += hd.hcount;
+  a->live[1] += hd.ccount; cellcount += hd.ccount;
+
+  DEBB(DF_INIT, (debugfile, "snapshot: mapped %lld heptagons and %lld cells in %d ms\n", hd.hcount, hd.ccount, int(SDL_GetTicks() - t0)));
+  return m;
+  }
+
+void load(const string& fname) {
+  if(!read_info(fname)) return;
+  stop_game();
+  set_geometry(hd.geometry);
+  set_variation(hd.variation);
+  base = NULL;
+  pending = fname;
+  start_game();
+  pending = "";
+  if(!base) return;
+  if(hd.kind == skBounded) cwt.at = currentmap->allcells()[hd.start];
+  else cwt.at = (cell*) (base + hd.start);
+  cwt.spin = hd.spin;
+  cwt.mirrored = hd.mirrored;
+  }
+
+#if CAP_COMMANDLINE
+int readArgs() {
+  using namespace arg;
+
+  if(0) ;
+  else if(argis("-savesnap")) {
+    PHASE(3); shift(); start_game();
+    save(args());
+    }
+  else if(argis("-loadsnap")) {
+    PHASE(3); shift();
+    load(args());
+    }
+  else return 1;
+  return 0;
+  }
+
+auto hookArg = addHook(hooks_args, 100, readArgs);
+#endif
+
+auto hooks = addHook(hooks_newmap, 0, load_map);
+
+}
+#endif
+
+}
@@ -233,6 +233,34 @@
 #define CAP_SHMUP 1
 #endif
 
+// store the neighbors of cells and heptagons as 32-bit handles (needs the slab arenas)
+#ifndef CAP_COMPRESSED_MOVES
+#define CAP_COMPRESSED_MOVES 0
+#endif
+
+#if CAP_COMPRESSED_MOVES && defined(NO_SLAB_ARENA)
+#error "CAP_COMPRESSED_MOVES requires the slab arenas"
+#endif
+
+// map snapshots which can be mapped back into memory (needs the slab arenas)
+#ifndef CAP_SNAPSHOT
+#if defined(NO_SLAB_ARENA)
+#define CAP_SNAPSHOT 0
+#else
+#define CAP_SNAPSHOT (ISLINUX || ISMAC)
+#endif
+#endif
+
+// threads for the CA engine (needs -pthread)
+#ifndef CAP_THREADS
+#define CAP_THREADS 0
+#endif
+
+// the game state is global, so parallel games (-batch) run as processes
+#ifndef CAP_BATCH
+#define CAP_BATCH (ISLINUX || ISMAC)
+#endif
+
 #ifdef ISSTEAM
 #define CAP_ACHIEVE 1
 #endif
@@ -380,8 +408,10 @@ extern "C" {
 #include <stdexcept>
 #include <array>
 #include <set>
+#include <list>
 #include <random>
 #include <complex>
+#include <chrono>
 
 #ifdef USE_UNORDERED_MAP
 #include <unordered_map>
@@ -414,6 +444,23 @@ extern "C" {
 #include <sys/time.h>
 #endif
 
+#if CAP_SNAPSHOT
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif
+
+#if CAP_BATCH
+#include <unistd.h>
+#include <sys/wait.h>
+#endif
+
+#if CAP_THREADS
+#include <thread>
+#include <mutex>
+#endif
+
 #ifdef BACKTRACE
 #include <execinfo.h>
 #endif
@@ -109,6 +109,11 @@ void initgame() {
     firstland = safetyland;
     }
   
+  if(position_rng) {
+    world_seed = hrngen();
+    world_seed = (world_seed << 32) | hrngen();
+    }
+  
   bool use_special_land = do_use_special_land();
     
   if(use_special_land) firstland = specialland;
@@ -281,7 +286,7 @@ void initgame() {
     safety = false;
     }
   
-  havewhat = hadwhat = 0; rosemap.clear();
+  havewhat = hadwhat = 0; clearRosemap();
   
   elec::lightningfast = 0;
   
@@ -1061,6 +1066,8 @@ namespace gamestack {
   void pop() {
     gamedata& gdn = gd[isize(gd)-1];
     currentmap = gdn.hmap;
+    // the cells created from now on belong to the restored map
+    current_arena = currentmap->arena;
     cwt = gdn.cwt;
     geometry = gdn.geometry;
     variation = gdn.variation;
@@ -94,6 +94,11 @@ ld frac(ld x) {
 
 // debug utilities
 
+// profiling categories 0-7 are used by the graphics; the categories
+// may nest (e.g., movemonsters calls bfs)
+
+enum { PROF_BFS = 8, PROF_MONSTERS, PROF_HEAT, PROF_SETDIST, PROF_CHECKMOVE };
+
 #if CAP_PROFILING
 
 #define FRAMES 64
@@ -102,13 +107,18 @@ ld frac(ld x) {
 long long proftable[16][FRAMES];
 int pframeid;
 
+long long getus() {
+  using namespace std::chrono;
+  return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+  }
+
 void profile_frame() { 
   pframeid++; pframeid %=  FRAMES;
   for(int t=0; t<16; t++) proftable[t][pframeid] = 0;
   }
 
-void profile_start(int t) { proftable[t][pframeid] -= getms(); }
-void profile_stop(int t) { proftable[t][pframeid] += getms(); }
+void profile_start(int t) { proftable[t][pframeid] -= getus(); }
+void profile_stop(int t) { proftable[t][pframeid] += getus(); }
 
 void profile_info() {
   for(int t=0; t<16; t++) {
@@ -116,7 +126,7 @@ void profile_info() {
     if(proftable[t][FRAMES-1] == 0) continue;
     long long sum = 0;
     for(int f=0; f<FRAMES; f++) sum += proftable[t][f];
-    printf("Category %d: avg = %Ld, %Ld..%Ld..%Ld..%Ld..%Ld\n",
+    printf("Category %d: avg = %lld, %lld..%lld..%lld..%lld..%lld (us)\n",
       t, sum / FRAMES, proftable[t][0], proftable[t][16], proftable[t][32],
       proftable[t][48], proftable[t][63]);
     }